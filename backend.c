@@ -0,0 +1,147 @@
+/*
+ * backend.c - the table of allocators linked into mdriver
+ *
+ * mm.c is linked under its own names. The other allocators are compiled
+ * with -DMM_PREFIX=<name>_ (see the Makefile and mm.h), which renames
+ * their mm_* entry points so they don't clash. libc malloc is wrapped
+ * here as well so it runs through the same code paths as the others.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include "backend.h"
+
+/* Declare the entry points of an allocator built with prefix p */
+#define DECLARE_BACKEND(p)                                      \
+    extern int p##mm_init(void);                                \
+    extern void *p##mm_malloc(size_t size);                     \
+    extern void p##mm_free(void *ptr);                          \
+    extern void *p##mm_realloc(void *ptr, size_t size);         \
+    extern void *p##mm_calloc(size_t nmemb, size_t size);       \
+    extern void p##mm_checkheap(int verbose);                   \
+    extern void p##mm_heapstats(mm_heapstats_t *stats);         \
+    extern void *p##mm_memalign(size_t alignment, size_t size); \
+    extern size_t p##mm_usable_size(void *ptr);                 \
+    extern mm_region_t *p##mm_region_create(size_t chunk_size); \
+    extern void *p##mm_region_alloc(mm_region_t *r, size_t size); \
+    extern void p##mm_region_reset(mm_region_t *r);             \
+    extern mm_pool_t *p##mm_pool_create(size_t obj_size, size_t align); \
+    extern void *p##mm_pool_get(mm_pool_t *pool);               \
+    extern void p##mm_pool_put(mm_pool_t *pool, void *obj);     \
+    extern void p##mm_pool_destroy(mm_pool_t *pool);            \
+    extern void *p##mm_malloc_hint(size_t size, int hint);      \
+    extern size_t p##mm_malloc_batch(size_t size, size_t n, void **out); \
+    extern void p##mm_free_batch(void **ptrs, size_t n);
+
+/* ... and of one built with -DMM_THREADS, which can purge, and whose
+   thread caches can use the size given to free_sized */
+#define DECLARE_PURGE(p)                                        \
+    extern int p##mm_purge_start(int decay_ms, int lazy);       \
+    extern void p##mm_purge_stop(void);                         \
+    extern void p##mm_free_sized(void *ptr, size_t size);
+
+/* Table entry fields every allocator built with prefix p has */
+#define BACKEND_FIELDS(n, p, ts)                                \
+    .name = n, .init = p##mm_init, .malloc = p##mm_malloc,      \
+    .free = p##mm_free, .realloc = p##mm_realloc,               \
+    .calloc = p##mm_calloc, .checkheap = p##mm_checkheap,       \
+    .threadsafe = ts, .heapstats = p##mm_heapstats
+
+/* ... and those that every build of mm.c adds */
+#define MM_FIELDS(p)                                            \
+    .memalign = p##mm_memalign, .usable_size = p##mm_usable_size, \
+    .region_create = p##mm_region_create,                       \
+    .region_alloc = p##mm_region_alloc,                         \
+    .region_reset = p##mm_region_reset,                         \
+    .pool_create = p##mm_pool_create,                           \
+    .pool_get = p##mm_pool_get,                                 \
+    .pool_put = p##mm_pool_put,                                 \
+    .pool_destroy = p##mm_pool_destroy,                         \
+    .malloc_hint = p##mm_malloc_hint,                           \
+    .malloc_batch = p##mm_malloc_batch,                         \
+    .free_batch = p##mm_free_batch
+
+/* Table entries for a build of mm.c, and a build of mm.c with
+   -DMM_THREADS */
+#define MM_BACKEND(n, p, ts)  { BACKEND_FIELDS(n, p, ts), MM_FIELDS(p) }
+#define PURGE_BACKEND(n, p)                                     \
+    { BACKEND_FIELDS(n, p, 1), MM_FIELDS(p),                    \
+      .purge_start = p##mm_purge_start, .purge_stop = p##mm_purge_stop, \
+      .free_sized = p##mm_free_sized }
+
+DECLARE_BACKEND(mt_)
+DECLARE_PURGE(mt_)
+DECLARE_BACKEND(mtlock_)
+DECLARE_PURGE(mtlock_)
+DECLARE_BACKEND(heaps_)
+DECLARE_BACKEND(arena_)
+DECLARE_BACKEND(addr_)
+DECLARE_BACKEND(high_)
+DECLARE_BACKEND(index_)
+DECLARE_BACKEND(bitmap_)
+DECLARE_BACKEND(naive_)
+
+/*
+ * libc malloc. Its memory can't be told apart from the driver's own,
+ * so the heap size is taken to be the bytes libc holds in chunks
+ * (including mmapped ones) beyond what it held when the trace started.
+ * That counts libc's per-chunk overhead and rounding, but not space
+ * lost between chunks.
+ */
+static size_t libc_base = 0;
+
+static size_t libc_inuse(void)
+{
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+static int libc_init(void)
+{
+    libc_base = libc_inuse();
+    return 0;
+}
+
+static size_t libc_heapsize(void)
+{
+    size_t inuse = libc_inuse();
+    return (inuse > libc_base) ? inuse - libc_base : 0;
+}
+
+static void libc_checkheap(int verbose __attribute__((unused)))
+{
+}
+
+const mm_backend_t mm_backends[] = {
+    MM_BACKEND("mm", , 0),
+    PURGE_BACKEND("mt", mt_),
+    PURGE_BACKEND("mtlock", mtlock_),
+    MM_BACKEND("heaps", heaps_, 1),
+    MM_BACKEND("arena", arena_, 1),
+    MM_BACKEND("addr", addr_, 0),
+    MM_BACKEND("high", high_, 0),
+    MM_BACKEND("index", index_, 0),
+    MM_BACKEND("bitmap", bitmap_, 0),
+    { BACKEND_FIELDS("naive", naive_, 0), .memalign = naive_mm_memalign,
+      .usable_size = naive_mm_usable_size },
+    { .name = "libc", .init = libc_init, .malloc = malloc, .free = free,
+      .realloc = realloc, .calloc = calloc, .checkheap = libc_checkheap,
+      .threadsafe = 1, .heapsize = libc_heapsize, .memalign = memalign,
+      .usable_size = malloc_usable_size },
+    { .name = NULL }
+};
+
+/*
+ * find_backend - look up an allocator by name
+ */
+const mm_backend_t *find_backend(const char *name)
+{
+    const mm_backend_t *b;
+
+    for (b = mm_backends; b->name != NULL; b++) {
+        if (strcmp(b->name, name) == 0)
+            return b;
+    }
+    return NULL;
+}
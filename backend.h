@@ -0,0 +1,73 @@
+/*
+ * backend.h - the allocators mdriver can run side by side
+ */
+#ifndef __BACKEND_H_
+#define __BACKEND_H_
+
+#include <stddef.h>
+#include "mm.h"
+
+/* The entry points of one allocator */
+typedef struct {
+    const char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void *(*calloc)(size_t nmemb, size_t size);
+    void (*checkheap)(int verbose);
+    int threadsafe;   /* may be called from several threads at once */
+
+    /* Optional (may be NULL): heap breakdown for fragmentation samples */
+    void (*heapstats)(mm_heapstats_t *stats);
+
+    /* Optional (may be NULL): heap size for allocators that don't get
+       their memory from memlib. When set, payloads aren't required to
+       lie inside the memlib heap and utilization is measured against
+       the largest value this returns during the trace. */
+    size_t (*heapsize)(void);
+
+    /* Optional (may be NULL): allocate size bytes at a multiple of
+       alignment, a power of two (the 'm' trace request) */
+    void *(*memalign)(size_t alignment, size_t size);
+
+    /* Optional (may be NULL): bytes usable at a block, at least the size
+       asked for; the driver checks no two such extents overlap */
+    size_t (*usable_size)(void *ptr);
+
+    /* Optional (may be NULL): regions for the 'x' and 'z' trace
+       requests; without them (or with -g) the driver frees each block
+       of a region itself when it is reset */
+    mm_region_t *(*region_create)(size_t chunk_size);
+    void *(*region_alloc)(mm_region_t *r, size_t size);
+    void (*region_reset)(mm_region_t *r);
+
+    /* Optional (may be NULL): pools for the 'p' trace request; without
+       them (or with -g) the driver replays it with malloc and free */
+    mm_pool_t *(*pool_create)(size_t obj_size, size_t align);
+    void *(*pool_get)(mm_pool_t *pool);
+    void (*pool_put)(mm_pool_t *pool, void *obj);
+    void (*pool_destroy)(mm_pool_t *pool);
+
+    /* Optional (may be NULL): malloc told whether the block will be
+       short- or long-lived (MM_HINT_*), for the hints of -L */
+    void *(*malloc_hint)(size_t size, int hint);
+
+    /* Optional (may be NULL): free told the size asked for, and malloc
+       and free of several blocks in one call, for -b */
+    void (*free_sized)(void *ptr, size_t size);
+    size_t (*malloc_batch)(size_t size, size_t n, void **out);
+    void (*free_batch)(void **ptrs, size_t n);
+
+    /* Optional (may be NULL): background purging of free pages (-u) */
+    int (*purge_start)(int decay_ms, int lazy);
+    void (*purge_stop)(void);
+} mm_backend_t;
+
+/* All allocators linked into mdriver, terminated by a NULL name */
+extern const mm_backend_t mm_backends[];
+
+/* Look up an allocator by name; NULL if there is no such allocator */
+const mm_backend_t *find_backend(const char *name);
+
+#endif /* __BACKEND_H_ */
@@ -6,11 +6,21 @@
  * May not be used, modified, or copied without permission.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include <sys/times.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
 #include "clock.h"
 
 
@@ -35,13 +45,14 @@ static unsigned cyc_lo = 0;
 
 
 /* Set *hi and *lo to the high and low order bits  of the cycle counter.  
-   Implementation requires assembly code to use the rdtsc instruction. */
+   Implementation requires assembly code to use the rdtscp instruction,
+   which unlike rdtsc waits for the code being timed to finish. */
 void access_counter(unsigned *hi, unsigned *lo)
 {
-    asm("rdtsc; movl %%edx,%0; movl %%eax,%1"   /* Read cycle counter */
+    asm volatile("rdtscp; movl %%edx,%0; movl %%eax,%1" /* Read counter */
         : "=r" (*hi), "=r" (*lo)                /* and move results to */
         : /* No input */                        /* the two outputs */
-        : "%edx", "%eax");
+        : "%edx", "%eax", "%ecx");              /* (ecx gets the cpu id) */
 }
 
 /* Record the current value of the cycle counter. */
@@ -72,6 +83,44 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+/*
+ * cpuid_mhz - The rate of an invariant TSC as the CPU or hypervisor
+ *     advertises it in CPUID, or 0 if it doesn't
+ */
+static double cpuid_mhz(const char **source)
+{
+    unsigned a, b, c, d, max;
+
+    /* A TSC that varies with the clock has no single rate */
+    __cpuid(0x80000000, max, b, c, d);
+    if (max < 0x80000007)
+        return 0;
+    __cpuid(0x80000007, a, b, c, d);
+    if (!(d & (1 << 8)))
+        return 0;
+
+    /* Leaf 0x15: TSC = crystal * ebx/eax, crystal in Hz in ecx */
+    __cpuid(0, max, b, c, d);
+    if (max >= 0x15) {
+        __cpuid_count(0x15, 0, a, b, c, d);
+        if (a != 0 && b != 0 && c != 0) {
+            *source = "cpuid";
+            return (double)c * b / a / 1e6;
+        }
+    }
+
+    /* Hypervisors report the TSC rate in kHz in leaf 0x40000010 */
+    __cpuid(0x40000000, max, b, c, d);
+    if (max >= 0x40000010 && max < 0x40010000) {
+        __cpuid(0x40000010, a, b, c, d);
+        if (a != 0) {
+            *source = "hypervisor cpuid";
+            return a / 1e3;
+        }
+    }
+    return 0;
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -181,48 +230,199 @@ double ovhd()
 }
 
 /* $begin mhz */
-/* Get the clock rate from /proc */
-double mhz_full(int verbose, int sleeptime __attribute__((unused)))
-{
-    static char buf[2048];
+/* Where the clock rate and timer interrupt overhead are remembered
+   between runs: in $XDG_CACHE_HOME, or else ~/.cache */
+#define MHZ_CACHE "mdriver-mhz"
 
-    FILE *fp = fopen("/proc/cpuinfo", "r");
-    double mhz = 0.0;
+/* Trust the advertised rate if calibration agrees to within this */
+#define MHZ_TOLERANCE 0.01
 
-    while (fgets(buf, 2048, fp)) {
-        if (strstr(buf, "cpu MHz")) {
-            sscanf(buf, "cpu MHz\t: %lf", &mhz);
-            break;
+/*
+ * sysfs_mhz - The TSC rate as the kernel reports it in sysfs, or 0
+ */
+static double sysfs_mhz(const char **source)
+{
+    static const char *files[] = {
+        "/sys/devices/system/cpu/cpu0/tsc_freq_khz",
+        "/sys/devices/system/cpu/cpu0/cpufreq/base_frequency",
+    };
+    unsigned i;
+    double khz;
+    FILE *fp;
+
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        if ((fp = fopen(files[i], "r")) == NULL)
+            continue;
+        if (fscanf(fp, "%lf", &khz) == 1 && khz > 0) {
+            fclose(fp);
+            *source = "sysfs";
+            return khz / 1e3;
         }
+        fclose(fp);
     }
-    fclose(fp);
-    if (verbose) 
-        printf("Processor clock rate ~= %.1f MHz\n", mhz);
-    return mhz;
+    return 0;
+}
 
-#if 0
-    double rate;
+/*
+ * calibrate_mhz - Count cycles over ms milliseconds of
+ *     CLOCK_MONOTONIC_RAW, which NTP doesn't slew
+ */
+static double calibrate_mhz(int ms)
+{
+    struct timespec t0, t1;
+    double cycles, usecs;
 
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
     start_counter();
-    sleep(sleeptime);
-    rate = get_counter() / (1e6*sleeptime);
+    do {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+        usecs = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+    } while (usecs < ms * 1e3);
+    cycles = get_counter();
+    return cycles / usecs;
+}
+
+/*
+ * read_boot_id - The rate is only cached for as long as the machine
+ *     stays up, so the cache is keyed by the kernel's boot id
+ */
+static int read_boot_id(char *id, int len)
+{
+    FILE *fp = fopen("/proc/sys/kernel/random/boot_id", "r");
+    int ok;
+
+    if (fp == NULL)
+        return 0;
+    ok = (fgets(id, len, fp) != NULL);
+    fclose(fp);
+    id[strcspn(id, "\n")] = '\0';
+    return ok && id[0] != '\0';
+}
+
+/*
+ * cache_dir - The directory the cache lives in, created if need be;
+ *     0 if there is none
+ */
+static int cache_dir(char *dir, int len)
+{
+    const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    int n;
+
+    if (xdg != NULL && xdg[0] == '/')
+        n = snprintf(dir, len, "%s", xdg);
+    else if (home != NULL && home[0] == '/')
+        n = snprintf(dir, len, "%s/.cache", home);
+    else
+        return 0;
+    if (n <= 0 || n >= len - (int)sizeof(MHZ_CACHE) - 8)
+        return 0;
+    return mkdir(dir, 0700) == 0 || errno == EEXIST;
+}
+
+/*
+ * load_cache - Read the clock rate and cycles per timer tick measured
+ *     earlier in this boot; each is 0 if it hasn't been
+ */
+static void load_cache(double *rate, double *cpt)
+{
+    char path[PATH_MAX], id[64], cached_id[64];
+    FILE *fp;
+    int fd;
+
+    *rate = *cpt = 0;
+    if (!read_boot_id(id, sizeof(id)) || !cache_dir(path, sizeof(path)))
+        return;
+    strcat(path, "/" MHZ_CACHE);
+    if ((fd = open(path, O_RDONLY | O_NOFOLLOW)) < 0)
+        return;
+    if ((fp = fdopen(fd, "r")) == NULL) {
+        close(fd);
+        return;
+    }
+    if (fscanf(fp, "%63s %lf %lf", cached_id, rate, cpt) != 3 ||
+        strcmp(cached_id, id) != 0 || *rate <= 0 || *cpt < 0)
+        *rate = *cpt = 0;
+    fclose(fp);
+}
+
+/*
+ * save_cache - Remember the clock rate and cycles per timer tick. The
+ *     file is written under a fresh name (mode 0600) and renamed into
+ *     place, so a reader never sees half of it and nothing already at
+ *     the path is written through.
+ */
+static void save_cache(double rate, double cpt)
+{
+    char dir[PATH_MAX], path[PATH_MAX], tmp[PATH_MAX], id[64];
+    FILE *fp;
+    int fd;
+
+    if (!read_boot_id(id, sizeof(id)) || !cache_dir(dir, sizeof(dir)))
+        return;
+    strcat(strcpy(path, dir), "/" MHZ_CACHE);
+    strcat(strcpy(tmp, dir), "/." MHZ_CACHE ".XXXXXX");
+    if ((fd = mkstemp(tmp)) < 0)
+        return;
+    if ((fp = fdopen(fd, "w")) == NULL) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+    fprintf(fp, "%s %.6f %.6f\n", id, rate, cpt);
+    if (fclose(fp) != 0 || rename(tmp, path) != 0)
+        unlink(tmp);
+}
+
+static double cyc_per_tick = 0.0;
+static int tick_calibrated = 0;     /* 0 is a valid cyc_per_tick */
+static void callibrate(int verbose);
+
+/* Get the clock rate of the cycle counter: from the cache if this boot
+   has measured it before, else as advertised by CPUID or sysfs if a
+   quick calibration against the system clock agrees, else as calibrated.
+   The cycles per timer tick are measured (or read) at the same time, so
+   that the cache is written once, with both. */
+double mhz_full(int verbose, int calibrate_ms)
+{
+    const char *source = "cached";
+    double rate, cpt, nominal, measured;
+
+    load_cache(&rate, &cpt);
+    if (rate <= 0) {
+        source = "calibrated";
+        measured = calibrate_mhz(calibrate_ms);
+#if defined(__i386__) || defined(__x86_64__)
+        if ((nominal = cpuid_mhz(&source)) == 0)
+#endif
+            nominal = sysfs_mhz(&source);
+        if (nominal > 0 && fabs(nominal - measured) <= MHZ_TOLERANCE * measured)
+            rate = nominal;
+        else {
+            rate = measured;
+            source = "calibrated";
+        }
+        callibrate(0);
+        save_cache(rate, cyc_per_tick);
+    }
+    else {
+        cyc_per_tick = cpt;
+        tick_calibrated = 1;
+    }
+
     if (verbose) 
-        printf("Processor clock rate ~= %.1f MHz\n", rate);
+        printf("Processor clock rate ~= %.1f MHz (%s)\n", rate, source);
     return rate;
-#endif
 }
 /* $end mhz */
 
-/* Version using a default sleeptime */
+/* Version using a default calibration time */
 double mhz(int verbose)
 {
-    return mhz_full(verbose, 2);
+    return mhz_full(verbose, 10);
 }
 
 /** Special counters that compensate for timer interrupt overhead */
 
-static double cyc_per_tick = 0.0;
-
 #define NEVENT 100
 #define THRESHOLD 1000
 #define RECORDTHRESH 3000
@@ -261,6 +461,7 @@ static void callibrate(int verbose)
             oldt = newt;
         }
     }
+    tick_calibrated = 1;
     if (verbose)
         printf("Setting cyc_per_tick to %f\n", cyc_per_tick);
 }
@@ -271,7 +472,9 @@ void start_comp_counter()
 {
     struct tms t;
 
-    if (cyc_per_tick == 0.0)
+    /* mhz measures it, or reads it from the cache, before timing
+       starts; this is for callers that time without asking */
+    if (!tick_calibrated)
         callibrate(0);
     times(&t);
     start_tick = t.tms_utime;
@@ -288,6 +491,10 @@ double get_comp_counter()
     times(&t);
     ticks = t.tms_utime - start_tick;
     ctime = time - ticks*cyc_per_tick;
+    /* More ticks than cycles to charge them to means the overhead per
+       tick is off for this run; don't let a sample go to zero or below */
+    if (ctime <= 0)
+        ctime = time;
     /*
       printf("Measured %.0f cycles.  Ticks = %d.  Corrected %.0f cycles\n",
       time, (int) ticks, ctime);
@@ -9,11 +9,13 @@ double get_counter();
 /* Measure overhead for counter */
 double ovhd();
 
-/* Determine clock rate of processor (using a default sleeptime) */
+/* Determine clock rate of the cycle counter (using a default
+   calibration time) */
 double mhz(int verbose);
 
-/* Determine clock rate of processor, having more control over accuracy */
-double mhz_full(int verbose, int sleeptime);
+/* Determine clock rate of the cycle counter, calibrating it (if it
+   isn't cached) for calibrate_ms milliseconds */
+double mhz_full(int verbose, int calibrate_ms);
 
 /** Special counters that compensate for timer interrupt overhead */
 
@@ -111,6 +111,19 @@
  */
 #define MAX_HEAP (100*(1<<20))  /* 100 MB */
 
+/*
+ * When comparing against a baseline results file (-B), a trace counts
+ * as a throughput regression only if its mean time is slower at this
+ * confidence level (one-sided Welch t test) ...
+ */
+#define REGRESS_CONFIDENCE 0.95
+
+/*
+ * ... and by more than this fraction. Utilization is deterministic, so
+ * a util drop of more than this fraction is always a regression.
+ */
+#define REGRESS_MIN_DELTA 0.01
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
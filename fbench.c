@@ -0,0 +1,276 @@
+/*
+ * fbench.c - Estimate the time (in CPU cycles) used by a function f,
+ *     as the median of repeated samples with a confidence interval
+ *
+ * After a number of untimed warm-up runs, samples are taken until the
+ * confidence interval of the median is narrow enough or a maximum is
+ * reached. Samples outside Tukey's fences (k interquartile ranges past
+ * the quartiles) are rejected as outliers, e.g. runs that were hit by
+ * an interrupt or descheduled. The interval is the distribution-free
+ * one given by order statistics, so it needs no normality assumption.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "fbench.h"
+#include "fcyc.h"
+#include "clock.h"
+#include "tstat.h"
+
+/* Default values */
+#define WARMUP 1             /* Untimed runs before sampling */
+#define MINREPS 5            /* Always take at least MINREPS samples */
+#define MAXREPS 50           /* Give up after MAXREPS samples */
+#define PRECISION 0.01       /* Half-width of the CI relative to the median */
+#define CONFIDENCE 0.95      /* Confidence level of the CI */
+#define OUTLIER_K 3.0        /* Tukey's fences for "far out" samples */
+#define CLEAR_CACHE 0        /* Clear cache before running test function */
+
+static int warmup = WARMUP;
+static int minreps = MINREPS;
+static int maxreps = MAXREPS;
+static double precision = PRECISION;
+static double confidence = CONFIDENCE;
+static double outlier_k = OUTLIER_K;
+static int clear_cache = CLEAR_CACHE;
+
+static double *samples = NULL;  /* every sample of the current run */
+static double *sorted = NULL;   /* the same, sorted, outliers removed */
+static int samplecount = 0;
+static fbench_result_t last_result;
+
+/*
+ * cmp_double - qsort comparison for doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * quantile - The q-quantile of the n sorted values in v, interpolating
+ *     between neighbours
+ */
+static double quantile(const double *v, int n, double q)
+{
+    double pos = q * (n - 1);
+    int i = (int)pos;
+
+    if (i >= n - 1)
+	return v[n-1];
+    return v[i] + (pos - i) * (v[i+1] - v[i]);
+}
+
+/*
+ * summarize - Reject outliers from the samples so far and compute the
+ *     median, its confidence interval and the spread of what remains
+ */
+static void summarize(fbench_result_t *r)
+{
+    int i, n = 0, lo, hi;
+    double q1, q3, fence_lo, fence_hi, z, h;
+    double sum = 0, sumsq = 0, var = 0;
+
+    for (i = 0; i < samplecount; i++)
+	sorted[i] = samples[i];
+    qsort(sorted, samplecount, sizeof(double), cmp_double);
+
+    /* Tukey's fences need a few samples to mean anything */
+    if (outlier_k > 0 && samplecount >= 4) {
+	q1 = quantile(sorted, samplecount, 0.25);
+	q3 = quantile(sorted, samplecount, 0.75);
+	fence_lo = q1 - outlier_k * (q3 - q1);
+	fence_hi = q3 + outlier_k * (q3 - q1);
+	for (i = 0; i < samplecount; i++)
+	    if (sorted[i] >= fence_lo && sorted[i] <= fence_hi)
+		sorted[n++] = sorted[i];
+    }
+    else
+	n = samplecount;
+
+    r->samples = n;
+    r->rejected = samplecount - n;
+    r->min = sorted[0];
+    r->max = sorted[n-1];
+    r->median = quantile(sorted, n, 0.5);
+
+    /*
+     * The median lies between the lo-th and hi-th order statistics
+     * with the given confidence, where the ranks come from the normal
+     * approximation to the binomial; a t with huge df is the normal.
+     */
+    z = tstat_quantile(1 - (1 - confidence) / 2, 1e9);
+    h = z * sqrt(n) / 2;
+    lo = (int)floor(n / 2.0 - h);
+    hi = (int)ceil(n / 2.0 + h);
+    if (lo < 0)
+	lo = 0;
+    if (hi > n - 1)
+	hi = n - 1;
+    r->ci_lo = sorted[lo];
+    r->ci_hi = sorted[hi];
+
+    for (i = 0; i < n; i++) {
+	sum += sorted[i];
+	sumsq += sorted[i] * sorted[i];
+    }
+    r->mean = sum / n;
+    if (n > 1) {
+	var = (sumsq - sum*sum/n) / (n-1);
+	if (var < 0)
+	    var = 0;
+    }
+    r->stddev = sqrt(var);
+}
+
+/*
+ * has_converged - Is the median known to within the precision?
+ */
+static int has_converged(fbench_result_t *r)
+{
+    if (samplecount < minreps)
+	return 0;
+    summarize(r);
+    return (r->ci_hi - r->median <= precision * r->median) &&
+	(r->median - r->ci_lo <= precision * r->median);
+}
+
+/*
+ * fbench - Estimate the median running time of function f
+ */
+double fbench(test_funct f, void *argp)
+{
+    int i;
+    double cyc;
+
+    if (samples == NULL) {
+	samples = calloc(maxreps, sizeof(double));
+	sorted = calloc(maxreps, sizeof(double));
+	if (samples == NULL || sorted == NULL) {
+	    fprintf(stderr, "Fatal error.  Calloc returned null in fbench\n");
+	    exit(1);
+	}
+    }
+
+    for (i = 0; i < warmup; i++)
+	f(argp);
+
+    samplecount = 0;
+    do {
+	if (clear_cache)
+	    fcyc_clear_cache();
+	start_counter();
+	f(argp);
+	cyc = get_counter();
+	samples[samplecount++] = cyc;
+    } while (samplecount < maxreps && !has_converged(&last_result));
+
+    summarize(&last_result);
+#ifdef DEBUG
+    printf(" median %.0f of %d samples (%d rejected), CI [%.0f, %.0f]\n",
+	   last_result.median, last_result.samples, last_result.rejected,
+	   last_result.ci_lo, last_result.ci_hi);
+#endif
+    return last_result.median;
+}
+
+/*
+ * get_fbench_result - Summary of the samples behind the last fbench result
+ */
+void get_fbench_result(fbench_result_t *result)
+{
+    *result = last_result;
+}
+
+
+/*************************************************************
+ * Set the various parameters used by the benchmark engine
+ ************************************************************/
+
+/*
+ * set_fbench_warmup - Number of untimed runs before sampling starts
+ *     Default = 1
+ */
+void set_fbench_warmup(int runs)
+{
+    warmup = runs;
+}
+
+/*
+ * set_fbench_reps - Take between minreps and maxreps samples
+ *     Default = 5, 50
+ */
+void set_fbench_reps(int minreps_arg, int maxreps_arg)
+{
+    minreps = minreps_arg;
+    if (maxreps_arg != maxreps) {
+	maxreps = maxreps_arg;
+	free(samples);
+	free(sorted);
+	samples = sorted = NULL;
+    }
+}
+
+/*
+ * set_fbench_precision - Target half-width of the CI, relative to
+ *     the median
+ *     Default = 0.01
+ */
+void set_fbench_precision(double precision_arg)
+{
+    precision = precision_arg;
+}
+
+/*
+ * set_fbench_confidence - Confidence level of the interval
+ *     Default = 0.95
+ */
+void set_fbench_confidence(double confidence_arg)
+{
+    confidence = confidence_arg;
+}
+
+/*
+ * set_fbench_outlier_k - Width of Tukey's fences in interquartile ranges
+ *     Default = 3
+ */
+void set_fbench_outlier_k(double k)
+{
+    outlier_k = k;
+}
+
+/*
+ * set_fbench_clear_cache - When set, clear the cache before each sample
+ *     Default = 0
+ */
+void set_fbench_clear_cache(int clear)
+{
+    clear_cache = clear;
+}
+
+/*
+ * set_fbench_cpu - Pin the process to one CPU, so that samples aren't
+ *     spread over cores with different caches and clock speeds
+ */
+int set_fbench_cpu(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+	return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+#else
+    cpu = cpu;
+    return -1;
+#endif
+}
@@ -0,0 +1,81 @@
+/*
+ * fbench.h - prototypes for the routines in fbench.c, a benchmark
+ *     engine that reports the median time of a test function f (in
+ *     CPU cycles) with a confidence interval, rather than the K-best
+ *     minimum that fcyc reports
+ */
+#ifndef __FBENCH_H_
+#define __FBENCH_H_
+
+#include "fcyc.h" /* for test_funct */
+
+/* Summary of the samples taken by the most recent call to fbench */
+typedef struct {
+    int samples;     /* samples kept after outlier rejection */
+    int rejected;    /* samples rejected as outliers */
+    double min;      /* fastest kept sample */
+    double max;      /* slowest kept sample */
+    double median;   /* median of the kept samples, i.e. what fbench returned */
+    double ci_lo;    /* confidence interval for the median */
+    double ci_hi;
+    double mean;     /* mean of the kept samples */
+    double stddev;   /* sample standard deviation of the kept samples */
+} fbench_result_t;
+
+/* Compute the median number of cycles used by test function f */
+double fbench(test_funct f, void *argp);
+
+void get_fbench_result(fbench_result_t *result);
+
+/*********************************************************
+ * Set the various parameters used by the benchmark engine
+ *********************************************************/
+
+/*
+ * set_fbench_warmup - Number of untimed runs before sampling starts
+ *     Default = 1
+ */
+void set_fbench_warmup(int runs);
+
+/*
+ * set_fbench_reps - Take between minreps and maxreps samples, stopping
+ *     as soon as the median is known to within the precision. With
+ *     minreps == maxreps, always take exactly that many.
+ *     Default = 5, 50
+ */
+void set_fbench_reps(int minreps, int maxreps);
+
+/*
+ * set_fbench_precision - Stop sampling once the confidence interval is
+ *     within this fraction of the median on either side
+ *     Default = 0.01
+ */
+void set_fbench_precision(double precision);
+
+/*
+ * set_fbench_confidence - Confidence level of the interval
+ *     Default = 0.95
+ */
+void set_fbench_confidence(double confidence);
+
+/*
+ * set_fbench_outlier_k - Reject samples more than k interquartile
+ *     ranges outside the quartiles (Tukey's fences); 0 keeps them all
+ *     Default = 3
+ */
+void set_fbench_outlier_k(double k);
+
+/*
+ * set_fbench_clear_cache - When set, clear the cache (as fcyc does)
+ *     before each sample
+ *     Default = 0
+ */
+void set_fbench_clear_cache(int clear);
+
+/*
+ * set_fbench_cpu - Pin the process to this CPU with sched_setaffinity.
+ *     Returns 0 on success and -1 if the CPU can't be used.
+ */
+int set_fbench_cpu(int cpu);
+
+#endif /* __FBENCH_H_ */
@@ -10,6 +10,8 @@
 #include <stdlib.h>
 #include <sys/times.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 
 #include "fcyc.h"
 #include "clock.h"
@@ -33,9 +35,19 @@ static int cache_block = CACHE_BLOCK;
 
 static int *cache_buf = NULL;
 
+/* If set, clear the cache by flushing just this range */
+static char *flush_lo = NULL;
+static size_t flush_bytes = 0;
+
 static double *values = NULL;
 static int samplecount = 0;
 
+/* Running totals over every sample, not just the K best */
+static double samplesum = 0;
+static double samplesumsq = 0;
+static double samplemax = 0;
+static fcyc_spread_t last_spread;
+
 /* for debugging only */
 #define KEEP_VALS 0
 #define KEEP_SAMPLES 0
@@ -59,6 +71,9 @@ static void init_sampler()
     samples = calloc(maxsamples+kbest, sizeof(double));
 #endif
     samplecount = 0;
+    samplesum = 0;
+    samplesumsq = 0;
+    samplemax = 0;
 }
 
 /* 
@@ -78,6 +93,10 @@ static void add_sample(double val)
     samples[samplecount] = val;
 #endif
     samplecount++;
+    samplesum += val;
+    samplesumsq += val*val;
+    if (val > samplemax)
+	samplemax = val;
     /* Insertion sort */
     while (pos > 0 && values[pos-1] > values[pos]) {
 	double temp = values[pos-1];
@@ -97,6 +116,39 @@ static int has_converged()
 	((1 + epsilon)*values[0] >= values[kbest-1]);
 }
 
+/*
+ * save_spread - Summarize all samples of the measurement just finished
+ */
+static void save_spread()
+{
+    double var = 0;
+
+    last_spread.samples = samplecount;
+    last_spread.min = values[0];
+    last_spread.max = samplemax;
+    last_spread.mean = samplesum / samplecount;
+    if (samplecount > 1) {
+	var = (samplesumsq - samplesum*samplesum/samplecount) / (samplecount-1);
+	if (var < 0)
+	    var = 0;
+    }
+    last_spread.stddev = sqrt(var);
+}
+
+/*
+ * flush - Evict every line of the flush range from all cache levels
+ */
+static void flush()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    char *p;
+
+    for (p = flush_lo; p < flush_lo + flush_bytes; p += cache_block)
+	asm volatile("clflush (%0)" : : "r" (p) : "memory");
+    asm volatile("mfence" : : : "memory");
+#endif
+}
+
 /* 
  * clear - Code to clear cache 
  */
@@ -107,12 +159,21 @@ static void clear()
     int x = sink;
     int *cptr, *cend;
     int incr = cache_block/sizeof(int);
+#if defined(__i386__) || defined(__x86_64__)
+    if (flush_bytes > 0) {
+	flush();
+	return;
+    }
+#endif
     if (!cache_buf) {
 	cache_buf = malloc(cache_bytes);
 	if (!cache_buf) {
 	    fprintf(stderr, "Fatal error.  Malloc returned null when trying to clear cache\n");
 	    exit(1);
 	}
+	/* Untouched pages all map to the zero page, which would stay
+	   cached; give the buffer real memory */
+	memset(cache_buf, 1, cache_bytes);
     }
     cptr = (int *) cache_buf;
     cend = cptr + cache_bytes/sizeof(int);
@@ -160,6 +221,7 @@ double fcyc(test_funct f, void *argp)
     }
 #endif
     result = values[0];
+    save_spread();
 #if !KEEP_VALS
     free(values); 
     values = NULL;
@@ -168,6 +230,73 @@ double fcyc(test_funct f, void *argp)
 }
 
 
+/*
+ * get_fcyc_spread - Spread of the samples behind the last fcyc result
+ */
+void get_fcyc_spread(fcyc_spread_t *spread)
+{
+    *spread = last_spread;
+}
+
+/*
+ * fcyc_llc_size - Size in bytes of the last-level data cache according
+ *     to sysfs, and its line size in *line; 0 if unknown
+ */
+int fcyc_llc_size(int *line)
+{
+    char path[128], type[32], unit;
+    int i, level, size, best_level = 0, best = 0;
+    FILE *fp;
+
+    *line = cache_block;
+    for (i = 0; ; i++) {
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+	if ((fp = fopen(path, "r")) == NULL)
+	    break;
+	if (fscanf(fp, "%d", &level) != 1)
+	    level = 0;
+	fclose(fp);
+
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+	if ((fp = fopen(path, "r")) == NULL)
+	    continue;
+	if (fscanf(fp, "%31s", type) != 1 || strcmp(type, "Instruction") == 0)
+	    level = 0;
+	fclose(fp);
+	if (level <= best_level)
+	    continue;
+
+	/* Sizes look like "48K" or "32M" */
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+	if ((fp = fopen(path, "r")) == NULL)
+	    continue;
+	unit = 0;
+	if (fscanf(fp, "%d%c", &size, &unit) >= 1 && size > 0) {
+	    best_level = level;
+	    best = size * (unit == 'K' ? 1 << 10 : unit == 'M' ? 1 << 20 : 1);
+	}
+	fclose(fp);
+
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/"
+		"coherency_line_size", i);
+	if (best_level == level && (fp = fopen(path, "r")) != NULL) {
+	    if (fscanf(fp, "%d", line) != 1)
+		*line = cache_block;
+	    fclose(fp);
+	}
+    }
+    return best;
+}
+
+/*
+ * fcyc_clear_cache - Clear the cache as fcyc does before each sample
+ */
+void fcyc_clear_cache(void)
+{
+    clear();
+}
+
+
 /*************************************************************
  * Set the various parameters used by the measurement routines 
  ************************************************************/
@@ -206,6 +335,18 @@ void set_fcyc_cache_block(int bytes) {
 }
 
 
+/*
+ * set_fcyc_flush_range - When bytes > 0, clear the cache by flushing
+ *     the lines of [lo, lo+bytes) with clflush instead (x86 only)
+ *     Default = 0
+ */
+void set_fcyc_flush_range(void *lo, size_t bytes)
+{
+    flush_lo = lo;
+    flush_bytes = bytes;
+}
+
+
 /* 
  * set_fcyc_compensate- When set, will attempt to compensate for 
  *     timer interrupt overhead 
@@ -6,6 +6,10 @@
  * May not be used, modified, or copied without permission.
  *
  */
+#ifndef __FCYC_H_
+#define __FCYC_H_
+
+#include <stddef.h>
 
 /* The test function takes a generic pointer as input */
 typedef void (*test_funct)(void *);
@@ -13,6 +17,24 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Spread of all the samples taken by the most recent call to fcyc */
+typedef struct {
+    int samples;     /* number of samples taken */
+    double min;      /* smallest sample, i.e. the value fcyc returned */
+    double max;      /* largest sample */
+    double mean;     /* mean of all samples */
+    double stddev;   /* sample standard deviation */
+} fcyc_spread_t;
+
+void get_fcyc_spread(fcyc_spread_t *spread);
+
+/* Run the same cache-clearing code fcyc runs before each sample */
+void fcyc_clear_cache(void);
+
+/* Size of the last-level cache according to sysfs (0 if unknown),
+   and its line size in *line */
+int fcyc_llc_size(int *line);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
@@ -36,6 +58,14 @@ void set_fcyc_cache_size(int bytes);
  */
 void set_fcyc_cache_block(int bytes);
 
+/*
+ * set_fcyc_flush_range - When bytes > 0, clear the cache by flushing
+ *     the lines of [lo, lo+bytes) with clflush rather than by walking
+ *     a buffer of the cache size (x86 only)
+ *     Default = 0
+ */
+void set_fcyc_flush_range(void *lo, size_t bytes);
+
 /* 
  * set_fcyc_compensate- When set, will attempt to compensate for 
  *     timer interrupt overhead 
@@ -63,6 +93,4 @@ void set_fcyc_maxsamples(int maxsamples_arg);
  */
 void set_fcyc_epsilon(double epsilon_arg);
 
-
-
-
+#endif /* __FCYC_H_ */
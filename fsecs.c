@@ -4,11 +4,20 @@
 #include <stdio.h>
 #include "fsecs.h"
 #include "fcyc.h"
+#include "fbench.h"
 #include "clock.h"
 #include "ftimer.h"
+#include "perfctr.h"
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+static fsecs_spread_t spread; /* spread behind the last fsecs result */
+static int engine = FSECS_FCYC; /* what times f with the cycle counter */
+static int llc_bytes = 0;       /* size of the last-level cache, if known */
+
+static int counters = 0;      /* count hardware events around each run? */
+static double counts[PERFCTR_NEVENTS]; /* behind the last fsecs result */
+static fsecs_test_funct counted_f;     /* the function being counted */
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -17,6 +26,10 @@ extern int verbose; /* -v option in mdriver.c */
  */
 void init_fsecs(void)
 {
+#if USE_FCYC
+    int line;
+#endif
+
     Mhz = 0; /* keep gcc -Wall happy */
 
 #if USE_FCYC
@@ -29,6 +42,18 @@ void init_fsecs(void)
     set_fcyc_compensate(1);
     set_fcyc_epsilon(0.01);
     set_fcyc_k(3);
+    set_fbench_clear_cache(1);
+
+    /* Evict by walking a buffer the size of the last-level cache, a
+       line at a time; if sysfs doesn't say how big it is,
+       set_fsecs_working_set gives the range to flush instead */
+    if ((llc_bytes = fcyc_llc_size(&line)) > 0) {
+	set_fcyc_cache_size(llc_bytes);
+	set_fcyc_cache_block(line);
+	if (verbose)
+	    printf("Evicting a %d KB last-level cache before each sample.\n",
+		   llc_bytes >> 10);
+    }
     Mhz = mhz(verbose > 0);
 #elif USE_ITIMER
     if (verbose)
@@ -39,19 +64,153 @@ void init_fsecs(void)
 #endif
 }
 
+/*
+ * set_fsecs_engine - choose between fcyc and fbench. Only the cycle
+ *     counter has an engine to choose; the interval timers ignore this.
+ */
+void set_fsecs_engine(int engine_arg)
+{
+    engine = engine_arg;
+    if (verbose && engine == FSECS_BENCH)
+	printf("Reporting the median of the samples with a confidence "
+	       "interval.\n");
+}
+
+/*
+ * set_fsecs_cache - start each sample with cold or warm caches
+ */
+void set_fsecs_cache(int mode)
+{
+    set_fcyc_clear_cache(mode == FSECS_COLD);
+    set_fbench_clear_cache(mode == FSECS_COLD);
+}
+
+/*
+ * set_fsecs_working_set - the range that cold samples flush when the
+ *     size of the caches is unknown
+ */
+void set_fsecs_working_set(void *lo, size_t bytes)
+{
+    if (llc_bytes == 0)
+	set_fcyc_flush_range(lo, bytes);
+}
+
+/*
+ * fsecs_enable_counters - count hardware events around each timed run
+ */
+int fsecs_enable_counters(void)
+{
+    int n = perfctr_init();
+
+    counters = (n > 0);
+    if (verbose) {
+	if (counters)
+	    printf("Counting %d hardware events with perf_event_open.\n", n);
+	else
+	    printf("No hardware event counters available; timing only.\n");
+    }
+    return counters;
+}
+
+/*
+ * counted - run the function being timed between perfctr_start and
+ *     perfctr_stop
+ */
+static void counted(void *argp)
+{
+    perfctr_start();
+    counted_f(argp);
+    perfctr_stop();
+}
+
 /*
  * fsecs - Return the running time of a function f (in seconds)
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
+    int i;
+
+    perfctr_reset();
+    if (counters) {
+	counted_f = f;
+	f = counted;
+    }
+    else {
+	for (i = 0; i < PERFCTR_NEVENTS; i++)
+	    counts[i] = -1;
+    }
+
 #if USE_FCYC
-    double cycles = fcyc(f, argp);
+    fcyc_spread_t cs;
+    fbench_result_t br;
+    double cycles;
+
+    if (engine == FSECS_BENCH) {
+	cycles = fbench(f, argp);
+	get_fbench_result(&br);
+	spread.samples = br.samples;
+	spread.rejected = br.rejected;
+	spread.min = br.min/(Mhz*1e6);
+	spread.max = br.max/(Mhz*1e6);
+	spread.mean = br.mean/(Mhz*1e6);
+	spread.stddev = br.stddev/(Mhz*1e6);
+	spread.median = br.median/(Mhz*1e6);
+	spread.ci_lo = br.ci_lo/(Mhz*1e6);
+	spread.ci_hi = br.ci_hi/(Mhz*1e6);
+    }
+    else {
+	cycles = fcyc(f, argp);
+	get_fcyc_spread(&cs);
+	spread.samples = cs.samples;
+	spread.rejected = 0;
+	spread.min = cs.min/(Mhz*1e6);
+	spread.max = cs.max/(Mhz*1e6);
+	spread.mean = cs.mean/(Mhz*1e6);
+	spread.stddev = cs.stddev/(Mhz*1e6);
+	spread.median = spread.ci_lo = spread.ci_hi = 0;
+    }
+    if (counters)
+	perfctr_read(counts);
     return cycles/(Mhz*1e6);
-#elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
+#else
+    /* The interval timers only report an average, so there is no spread */
+#if USE_ITIMER
+    double secs = ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
+    double secs = ftimer_gettod(f, argp, 10);
+#endif
+    if (counters)
+	perfctr_read(counts);
+    spread.samples = 1;
+    spread.rejected = 0;
+    spread.min = secs;
+    spread.max = secs;
+    spread.mean = secs;
+    spread.stddev = 0;
+    spread.median = spread.ci_lo = spread.ci_hi = 0;
+    return secs;
 #endif 
 }
 
+/*
+ * get_fsecs_spread - Return the spread of the samples behind the
+ *     most recent fsecs result
+ */
+void get_fsecs_spread(fsecs_spread_t *s)
+{
+    *s = spread;
+}
+
+/*
+ * get_fsecs_counters - Return the mean hardware event counts per run
+ *     behind the most recent fsecs result
+ */
+void get_fsecs_counters(double *c)
+{
+    int i;
+
+    for (i = 0; i < PERFCTR_NEVENTS; i++)
+	c[i] = counts[i];
+}
+
 
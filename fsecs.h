@@ -1,4 +1,42 @@
+#include <stddef.h>
+
 typedef void (*fsecs_test_funct)(void *);
 
+/* Spread of the timing samples behind the most recent fsecs result */
+typedef struct {
+    int samples;     /* number of samples */
+    int rejected;    /* samples dropped as outliers (bench engine) */
+    double min;      /* fastest sample (secs) */
+    double max;      /* slowest sample (secs) */
+    double mean;     /* mean of the samples (secs) */
+    double stddev;   /* sample standard deviation (secs) */
+    double median;   /* median and its confidence interval (secs); */
+    double ci_lo;    /* 0 unless the bench engine took the samples */
+    double ci_hi;
+} fsecs_spread_t;
+
+/* Engines that fsecs can time with when using the cycle counter */
+#define FSECS_FCYC  0   /* minimum of a K-best scheme (fcyc.c), the default */
+#define FSECS_BENCH 1   /* median with confidence interval (fbench.c) */
+
+/* Cache state that each sample starts from */
+#define FSECS_COLD  0   /* caches evicted before every sample, the default */
+#define FSECS_WARM  1   /* samples run back to back without eviction */
+
 void init_fsecs(void);
+void set_fsecs_engine(int engine);
+void set_fsecs_cache(int mode);
+
+/* Memory the function being timed works on. Cold samples flush it
+   from the caches if the size of the caches is unknown. */
+void set_fsecs_working_set(void *lo, size_t bytes);
 double fsecs(fsecs_test_funct f, void *argp);
+void get_fsecs_spread(fsecs_spread_t *spread);
+
+/* Also count hardware events around every timed run. Returns 0 if
+   there are no counters, in which case timing carries on without */
+int fsecs_enable_counters(void);
+
+/* Mean hardware event counts per run behind the last fsecs result,
+   PERFCTR_NEVENTS of them (see perfctr.h); -1 where not counted */
+void get_fsecs_counters(double *counts);
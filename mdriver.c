@@ -10,6 +10,8 @@
 #include <assert.h>
 #include <errno.h>
 #include <float.h>
+#include <pthread.h>
+#include <sched.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -21,8 +23,12 @@
 
 
 #include "mm.h"
+#include "backend.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "fbench.h"
+#include "tstat.h"
+#include "perfctr.h"
 #include "config.h"
 
 /**********************
@@ -31,9 +37,18 @@
 
 /* Misc */
 #define MAXLINE     1024 /* max string size */
+#define MAXNAME       32 /* max allocator name size */
+#define MAXBACKENDS   16 /* max allocators run in one invocation */
+#define MAXTHREADS    16 /* max threads in a multi-threaded replay (-T) */
+#define MAXSWEEP       5 /* thread counts in a sweep: 1, 2, 4 ... MAXTHREADS */
+#define THREAD_RUNS    3 /* multi-threaded replays per thread count */
+#define BATCH_MAX     64 /* most requests made in one batch call (-b) */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Payload-touching replay reads one byte per line of this size */
+#define CACHE_LINE    64
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
 
@@ -64,9 +79,19 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
+    enum { ALLOC, FREE, REALLOC, RESET } type; /* type of request */
     int index;                        /* index for free() to use later */
     size_t size;                      /* byte size of alloc/realloc request */
+    size_t align;                     /* payload alignment of an 'm' alloc, or 0 */
+    int region;                       /* region of an 'x' alloc or a reset, or -1 */
+    int pool;                         /* pool of a 'p' alloc or of the free of
+                                         its block, or -1 */
+    int hint;                         /* lifetime hint of an alloc (-L) */
+    int thread;                       /* trace thread that makes the request */
+    int dep;                          /* previous request on the same block */
+    int batch;                        /* with -b, the size of a run of requests
+                                         made in one call on the request that
+                                         makes it, -1 on the others, or 0 */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -75,11 +100,22 @@ typedef struct {
     int ignore_ranges;   /* don't check ranges (i.e. this is too big) */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
+    int num_threads;     /* number of trace threads (1 for plain traces) */
+    int num_aligned;     /* number of aligned ('m') allocs */
+    int num_regions;     /* number of regions ('x' and 'z' requests) */
+    mm_region_t **regions; /* each region, once it is first used... */
+    int *region_head;    /* ... the last block allocated in it since its */
+    int *region_next;    /* reset, and the one allocated before each block */
+    int num_pools;       /* number of pools ('p' requests) */
+    mm_pool_t **pools;   /* each pool, once it is first used */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
     int *block_rand_base;/* index into random_data, if debug is on */
+    int *live_ids;       /* ids of the live blocks, for payload touching... */
+    int *live_pos;       /* ... and the position of each id in live_ids */
+    int num_live;        /* number of entries in live_ids */
 } trace_t;
 
 /*
@@ -90,12 +126,14 @@ typedef struct {
 typedef struct {
     trace_t *trace;
     range_t *ranges;
+    int inplace;     /* reallocs that returned the same block, last run */
 } speed_t;
 
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* set in read_trace */
     char filename[MAXLINE];
+    char allocator[MAXNAME]; /* name of the allocator that ran the trace */
     int weight;
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
 
@@ -103,8 +141,38 @@ typedef struct {
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
 
-    /* defined only for the student malloc package */
-    double util;     /* space utilization for this trace (always 0 for libc) */
+    /* spread of the timing samples; secs is the fastest of them, or
+       their median with -e bench */
+    int samples;     /* number of samples */
+    int rejected;    /* samples dropped as outliers (-e bench) */
+    double secs_mean;/* mean secs over all samples */
+    double secs_min; /* fastest sample */
+    double secs_max; /* slowest sample */
+    double secs_sd;  /* standard deviation of the samples */
+    double secs_median; /* median and its confidence interval; */
+    double secs_ci_lo;  /* 0 unless timed with -e bench */
+    double secs_ci_hi;
+
+    /* mean hardware event counts per run (-1 if not counted, see -H) */
+    double hw[PERFCTR_NEVENTS];
+
+    /* secs with caches left warm between samples (-m warm or both) */
+    double secs_warm;
+
+    /* multi-threaded replay (-T) with 1, 2, 4 ... threads: the wall
+       time of the fastest run and the Kops of each of its threads */
+    int nsweep;
+    int sweep_threads[MAXSWEEP];
+    double sweep_secs[MAXSWEEP];
+    double sweep_kops[MAXSWEEP][MAXTHREADS];
+
+    double util;     /* space utilization for this trace */
+
+    /* reallocs in the trace, and how many of them returned the same
+       block in the util run and in the (last) speed run */
+    int reallocs;
+    int inplace_util;
+    int inplace_speed;
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -132,11 +200,48 @@ static enum { DBG_NONE, DBG_CHEAP, DBG_EXPENSIVE } debug_mode = DBG_CHEAP;
 
 int verbose = 1;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static const mm_backend_t *mm; /* the allocator being evaluated */
 int onetime_flag = 0;
 
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* Fragmentation time series written by eval_mm_util (-F, -N) */
+static FILE *frag_file = NULL;
+static int frag_interval = 1000;
+
+/* Payload-touching replay (-P) */
+static int touch_payloads = 0;     /* replay with eval_mm_speed_touch */
+static double touch_fraction = 0;  /* live blocks read after each op */
+static volatile unsigned touch_sink;
+
+/* Most threads to replay traces on (-T); 0 for no threaded replay */
+static int max_threads = 0;
+
+/* Cache state each timing sample starts from (-m): with both, secs
+   is the cold time and secs_warm the warm one */
+static int time_cold = 1;
+static int time_warm = 0;
+
+/* Decay time (ms) of the allocator's purge thread (-u); 0 for none */
+static int purge_ms = 0;
+static int purge_lazy = 0;
+
+/* Replay region and pool requests with malloc and free even if the
+   allocator has regions and pools (-g); use_regions and use_pools are
+   whether the current one does */
+static int plain_regions = 0;
+static int use_regions = 0;
+static int use_pools = 0;
+
+/* Hint mallocs of blocks that live for more than this many requests
+   as long-lived and the rest as short-lived (-L); 0 for no hints */
+static int hint_lifetime = 0;
+
+/* Free with mm_free_sized, and make runs of mallocs of one size and
+   runs of frees with mm_malloc_batch and mm_free_batch (-b) */
+static int batch_calls = 0;
+
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
@@ -169,18 +274,36 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
 
-/* Routines for evaluating the correctness and speed of libc malloc */
-static int eval_libc_valid(trace_t *trace);
-static void eval_libc_speed(void *ptr);
-
 /* Routines for evaluating correctnes, space utilization, and speed
-   of the student's malloc package in mm.c */
+   of an allocator (mm.c, libc, ...) */
+static void *trace_alloc(trace_t *trace, const traceop_t *op);
+static void trace_free(trace_t *trace, const traceop_t *op, void *p);
+static void trace_reset(trace_t *trace, const traceop_t *op);
+static void trace_destroy_pools(trace_t *trace);
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum);
+static double eval_mm_util(trace_t *trace, int tracenum, int *inplace);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_speed_touch(void *ptr);
+static void eval_mm_threads(trace_t *trace, stats_t *stats);
+static void sample_frag(const trace_t *trace, int opnum, int live_bytes);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printtiming(int n, stats_t *stats);
+static void printcache(int n, stats_t *stats);
+static void printthreads(int n, stats_t *stats);
+static void printreallocs(int n, stats_t *stats);
+static void printcombined(int nbackends, const mm_backend_t **backends,
+                          int n, stats_t *stats);
+static double perfindex(int n, stats_t *stats, double *avg_util,
+                        double *avg_throughput, double *p1, double *p2);
+static int select_backends(char *list, const mm_backend_t **backends);
+static void save_spread(stats_t *stats);
+static void write_results(const char *file, int n, stats_t *stats);
+static stats_t *read_results(const char *file, int *n);
+static int compare_results(int n, stats_t *stats, const char *basefile,
+                           double confidence);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -205,12 +328,20 @@ static void run_tests(int num_tracefiles, const char *tracedir,
                       stats_t *mm_stats, range_t *ranges, speed_t *speed_params) {
     volatile int i;
     volatile int timed_out = 0;
+    fsecs_test_funct speed;
 
     for (i=0; i < num_tracefiles; i++) {
         /* initialize simulated memory system in memlib.c *
          * start each trace with a clean system */
         mem_init();
 
+        /* The purge thread walks the heap, so it only runs while the
+           heap is mapped */
+        if (purge_ms > 0 && mm->purge_start != NULL &&
+            mm->purge_start(purge_ms, purge_lazy) < 0)
+            unix_error("Could not start the purge thread of %s malloc",
+                       mm->name);
+
         /* handle timeouts */
         if(setjmp(timeout_jmpbuf) != 0) {
             timed_out = 1;
@@ -219,15 +350,18 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         trace_t *trace;
         trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
         strcpy(mm_stats[i].filename, trace->filename);
+        strcpy(mm_stats[i].allocator, mm->name);
         mm_stats[i].ops = trace->num_ops;
         if(timed_out) {
             mm_stats[i].valid = 0;
         } else {
             if (verbose > 1)
-                printf("Checking mm_malloc for correctness, ");
+                printf("Checking %s malloc for correctness, ", mm->name);
             mm_stats[i].valid = eval_mm_valid(trace, &ranges);
 
             if (onetime_flag) {
+                if (purge_ms > 0 && mm->purge_stop != NULL)
+                    mm->purge_stop();
                 free_trace(trace);
                 return;
             }
@@ -235,17 +369,38 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         if (mm_stats[i].valid) {
             if (verbose > 1)
                 printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i);
+            mm_stats[i].util = eval_mm_util(trace, i,
+                                            &mm_stats[i].inplace_util);
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
                 printf("and performance.\n");
-            mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+            speed = touch_payloads ? eval_mm_speed_touch : eval_mm_speed;
+            if (mm->heapsize == NULL)
+                set_fsecs_working_set(mem_heap_lo(), mem_heapsize());
+            if (time_cold) {
+                set_fsecs_cache(FSECS_COLD);
+                mm_stats[i].secs = fsecs(speed, speed_params);
+                save_spread(&mm_stats[i]);
+            }
+            if (time_warm) {
+                set_fsecs_cache(FSECS_WARM);
+                mm_stats[i].secs_warm = fsecs(speed, speed_params);
+                if (!time_cold) {
+                    mm_stats[i].secs = mm_stats[i].secs_warm;
+                    save_spread(&mm_stats[i]);
+                }
+            }
+            mm_stats[i].inplace_speed = speed_params->inplace;
+            if (max_threads > 0)
+                eval_mm_threads(trace, &mm_stats[i]);
         }
 
         free_trace(trace);
 
         /* clean up memory system */
+        if (purge_ms > 0 && mm->purge_stop != NULL)
+            mm->purge_stop();
         mem_deinit();
     }
 }
@@ -255,23 +410,36 @@ static void run_tests(int num_tracefiles, const char *tracedir,
  **************/
 int main(int argc, char **argv)
 {
-    int i;
+    int i, b;
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
 
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
-    stats_t *libc_stats = NULL;/* libc stats for each trace */
-    stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    stats_t *all_stats = NULL; /* stats for each allocator and trace */
+    stats_t *mm_stats = NULL;  /* stats of one allocator for each trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */
 
+    char *backend_list = NULL; /* allocators to run (set by -a) */
+    const mm_backend_t *backends[MAXBACKENDS];
+    int backend_errors[MAXBACKENDS];
+    int nbackends;
     int run_libc = 0;     /* If set, run libc malloc (set by -l) */
+    int hw_counters = 0;  /* If set, count hardware events (set by -H) */
+    int engine = FSECS_FCYC;   /* timing engine (set by -e) */
+    int warmup = -1;           /* bench engine parameters (-w, -r, -p); */
+    int minreps = -1, maxreps = -1; /* -1 leaves the default */
+    int cpu = -1;
     int autograder = 0;   /* if set then called by autograder (-A) */
+    char *resultfile = NULL;   /* write per-trace results here (-o) */
+    char *basefile = NULL;     /* compare against these results (-B) */
+    double confidence = REGRESS_CONFIDENCE; /* for the comparison (-z) */
+    int regressions = 0;
 
     /* temporaries used to compute the performance index */
-    double secs, ops, util, avg_mm_util, avg_mm_throughput = 0, p1, p2, perfindex;
-    double util_weight = 0, perf_weight = 0;
-    int numcorrect;
+    double avg_mm_util, avg_mm_throughput, p1, p2, index;
+    double perf = 0, auto_util = 0, auto_throughput = 0;
+    int numcorrect = 0;
 
 
     setbuf(stdout, 0);
@@ -280,13 +448,17 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "a:d:e:f:c:m:p:r:s:t:u:v:w:F:N:o:B:z:P:T:L:hVAlDHgb")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
             autograder = 1;
             break;
 
+        case 'a': /* Comma-separated list of allocators to run */
+            backend_list = optarg;
+            break;
+
         case 'f': /* Use one specific trace file only (relative to curr dir) */
             num_tracefiles = 1;
             if ((tracefiles = realloc(tracefiles, 2 * sizeof(char *))) == NULL)
@@ -318,6 +490,58 @@ int main(int argc, char **argv)
             run_libc = 1;
             break;
 
+        case 'H': /* Count hardware events around each timed run */
+            hw_counters = 1;
+            break;
+
+        case 'e': /* Timing engine: fcyc (K-best) or bench (median) */
+            if (strcmp(optarg, "fcyc") == 0)
+                engine = FSECS_FCYC;
+            else if (strcmp(optarg, "bench") == 0)
+                engine = FSECS_BENCH;
+            else
+                app_error("Unknown timing engine %s\n", optarg);
+            break;
+
+        case 'm': /* Time with cold caches, warm caches, or both */
+            time_cold = (strcmp(optarg, "cold") == 0 ||
+                         strcmp(optarg, "both") == 0);
+            time_warm = (strcmp(optarg, "warm") == 0 ||
+                         strcmp(optarg, "both") == 0);
+            if (!time_cold && !time_warm)
+                app_error("Cache mode must be cold, warm or both\n");
+            break;
+
+        case 'w': /* Untimed warm-up runs before sampling (bench) */
+            warmup = atoi(optarg);
+            if (warmup < 0)
+                app_error("Warm-up runs must not be negative\n");
+            break;
+
+        case 'r': /* Samples per trace, <n> or adaptive <min>:<max> (bench) */
+            if (sscanf(optarg, "%d:%d", &minreps, &maxreps) == 1)
+                maxreps = minreps;
+            if (minreps < 1 || maxreps < minreps)
+                app_error("Bad repetition count %s\n", optarg);
+            break;
+
+        case 'p': /* Pin to one CPU while timing */
+            cpu = atoi(optarg);
+            break;
+
+        case 'T': /* Also replay on 1, 2, 4 ... up to <n> threads */
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > MAXTHREADS)
+                app_error("Threads must be between 1 and %d\n", MAXTHREADS);
+            break;
+
+        case 'u': /* Purge free pages in the background: <ms>[:lazy] */
+            purge_ms = atoi(optarg);
+            purge_lazy = (strstr(optarg, ":lazy") != NULL);
+            if (purge_ms <= 0)
+                app_error("Purge decay time must be positive\n");
+            break;
+
         case 'V': /* Increase verbosity level */
             verbose += 1;
             break;
@@ -338,6 +562,55 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'F': /* Write fragmentation samples to a CSV file */
+            if ((frag_file = fopen(optarg, "w")) == NULL)
+                unix_error("Could not open %s for writing", optarg);
+            fprintf(frag_file, "allocator,trace,op,heap_bytes,live_bytes,"
+                    "free_bytes,largest_free,internal_frag,"
+                    "dirty_bytes,purged_bytes\n");
+            break;
+
+        case 'N': /* Sample fragmentation every <n> operations */
+            frag_interval = atoi(optarg);
+            if (frag_interval <= 0)
+                app_error("Sampling interval must be positive\n");
+            break;
+
+        case 'P': /* Touch payloads, reading a fraction of live blocks */
+            touch_payloads = 1;
+            touch_fraction = atof(optarg);
+            if (touch_fraction < 0 || touch_fraction > 1)
+                app_error("Touch fraction must be between 0 and 1\n");
+            break;
+
+        case 'o': /* Write per-trace results as JSON or CSV */
+            resultfile = optarg;
+            break;
+
+        case 'B': /* Compare against a baseline results file */
+            basefile = optarg;
+            break;
+
+        case 'z': /* Confidence level for the baseline comparison */
+            confidence = atof(optarg);
+            if (confidence <= 0.5 || confidence >= 1.0)
+                app_error("Confidence must be between 0.5 and 1\n");
+            break;
+
+        case 'L': /* Lifetime hints from the trace */
+            hint_lifetime = atoi(optarg);
+            if (hint_lifetime <= 0)
+                app_error("Lifetime must be positive\n");
+            break;
+
+        case 'g': /* Replay regions and pools with malloc and free */
+            plain_regions = 1;
+            break;
+
+        case 'b': /* Use the sized and batch entry points */
+            batch_calls = 1;
+            break;
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -354,12 +627,32 @@ int main(int argc, char **argv)
         printf("Using default tracefiles in %s\n", tracedir);
     }
 
+    /* -l runs libc ahead of the student's package, as it always has */
+    nbackends = 0;
+    if (run_libc)
+        backends[nbackends++] = find_backend("libc");
+    nbackends += select_backends(backend_list ? backend_list : "mm",
+                                 backends + nbackends);
+
     if(debug_mode != DBG_NONE) {
         init_random_data();
     }
 
+    if (touch_payloads && verbose)
+        printf("Throughput includes touching payloads "
+               "(reading %g of live blocks per op).\n", touch_fraction);
+
     /* Initialize the timing package */
     init_fsecs();
+    set_fsecs_engine(engine);
+    if (warmup >= 0)
+        set_fbench_warmup(warmup);
+    if (minreps > 0)
+        set_fbench_reps(minreps, maxreps);
+    if (cpu >= 0 && set_fbench_cpu(cpu) < 0)
+        unix_error("Could not pin to CPU %d", cpu);
+    if (hw_counters)
+        hw_counters = fsecs_enable_counters();
 
     /* Initialize the timeout */
     if (set_timeout > 0) {
@@ -367,180 +660,145 @@ int main(int argc, char **argv)
         alarm(set_timeout); 
     }
 
-    /*
-     * Optionally run and evaluate the libc malloc package
-     */
-    if (run_libc) {
-        if (verbose > 1)
-            printf("\nTesting libc malloc\n");
-
-        /* Allocate libc stats array, with one stats_t struct per tracefile */
-        libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-        if (libc_stats == NULL)
-            unix_error("libc_stats calloc in main failed");
-
-        /* Evaluate the libc malloc package using the K-best scheme */
-        for (i=0; i < num_tracefiles; i++) {
-            trace_t *trace = read_trace(&libc_stats[i], tracedir, tracefiles[i]);
-
-            if (verbose > 1)
-                printf("Checking libc malloc for correctness, ");
-            libc_stats[i].valid = eval_libc_valid(trace);
-            if (libc_stats[i].valid) {
-                speed_params.trace = trace;
-                if (verbose > 1)
-                    printf("and performance.\n");
-                libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-            }
-            free_trace(trace);
-        }
-
-        /* Display the libc results in a compact table */
-        if (verbose) {
-            printf("\nResults for libc malloc:\n");
-            printresults(num_tracefiles, libc_stats);
-        }
-    }
+    /* Allocate the stats array, with one stats_t struct per allocator
+       and tracefile */
+    all_stats = (stats_t *)calloc(nbackends * num_tracefiles, sizeof(stats_t));
+    if (all_stats == NULL)
+        unix_error("all_stats calloc in main failed");
 
     /*
-     * Always run and evaluate the student's mm package
+     * Run and evaluate each allocator on the same traces
      */
-    if (verbose > 1)
-        printf("\nTesting mm malloc\n");
+    for (b = 0; b < nbackends; b++) {
+        mm = backends[b];
+        mm_stats = all_stats + b * num_tracefiles;
+        errors = 0;
+        use_regions = mm->region_create != NULL && !plain_regions;
+        use_pools = mm->pool_create != NULL && !plain_regions;
 
-    /* Allocate the mm stats array, with one stats_t struct per tracefile */
-    mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-    if (mm_stats == NULL)
-        unix_error("mm_stats calloc in main failed");
+        if (verbose > 1)
+            printf("\nTesting %s malloc\n", mm->name);
 
-    run_tests(num_tracefiles, tracedir, tracefiles, mm_stats,
-              ranges, &speed_params);
+        if (purge_ms > 0 && mm->purge_start == NULL)
+            printf("%s malloc can't purge; ignoring -u\n", mm->name);
 
+        run_tests(num_tracefiles, tracedir, tracefiles, mm_stats,
+                  ranges, &speed_params);
+        backend_errors[b] = errors;
 
-    /* Display the mm results in a compact table */
-    if (verbose) {
-        if (onetime_flag) {
-            printf("\n\ncorrectness check finished, by running tracefile \"%s\".\n", tracefiles[num_tracefiles-1]);
-            if (mm_stats[num_tracefiles-1].valid) {
-                printf(" => correct.\n\n");
+        /* Display the results in a compact table */
+        if (verbose) {
+            if (onetime_flag) {
+                printf("\n\ncorrectness check finished, by running tracefile \"%s\".\n", tracefiles[num_tracefiles-1]);
+                if (mm_stats[num_tracefiles-1].valid) {
+                    printf(" => correct.\n\n");
+                } else {
+                    printf(" => incorrect.\n\n");
+                }
             } else {
-                printf(" => incorrect.\n\n");
+                printf("\nResults for %s malloc:\n", mm->name);
+                printresults(num_tracefiles, mm_stats);
+                printf("\n");
+                if (engine == FSECS_BENCH) {
+                    printf("Timing of %s malloc (secs):\n", mm->name);
+                    printtiming(num_tracefiles, mm_stats);
+                    printf("\n");
+                }
+                if (time_cold && time_warm) {
+                    printf("Cold vs warm caches for %s malloc:\n", mm->name);
+                    printcache(num_tracefiles, mm_stats);
+                    printf("\n");
+                }
+                for (i = 0; i < num_tracefiles; i++)
+                    if (mm_stats[i].reallocs > 0)
+                        break;
+                if (i < num_tracefiles) {
+                    printf("In-place reallocs of %s malloc:\n", mm->name);
+                    printreallocs(num_tracefiles, mm_stats);
+                    printf("\n");
+                }
+                if (max_threads > 0) {
+                    printf("Threaded replay of %s malloc:\n", mm->name);
+                    printthreads(num_tracefiles, mm_stats);
+                    printf("\n");
+                }
+                if (hw_counters) {
+                    printf("Hardware events per op for %s malloc:\n",
+                           mm->name);
+                    printcounters(num_tracefiles, mm_stats);
+                    printf("\n");
+                }
             }
-        } else {
-            printf("\nResults for mm malloc:\n");
-            printresults(num_tracefiles, mm_stats);
-            printf("\n");
         }
     }
 
-    /*
-     * Accumulate the aggregate statistics for the student's mm package
-     */
-    secs = 0;
-    ops = 0;
-    util = 0;
-    numcorrect = 0;
-    
-
-    /*
-     * trace weight:
-     * weight 1 => count both util and perf
-     *        2 => count only util
-     *        3 => count only perf
-     */
-    for (i=0; i < num_tracefiles; i++) {
-        if(mm_stats[i].weight == WALL || mm_stats[i].weight == WPERF)
-            {
-                secs += mm_stats[i].secs;
-                ops += mm_stats[i].ops;
-                perf_weight++;
-            }
-        if(mm_stats[i].weight == WALL || mm_stats[i].weight == WUTIL)
-            {
-                util += mm_stats[i].util;
-                util_weight++;
-            }
-
-        if (mm_stats[i].valid)
-            numcorrect++;
+    if (verbose && !onetime_flag && nbackends > 1) {
+        printf("Combined results:\n");
+        printcombined(nbackends, backends, num_tracefiles, all_stats);
+        printf("\n");
     }
 
-    if(util_weight == 0)
-        avg_mm_util = 0;
-    else
-        avg_mm_util = util/util_weight;
-
     /*
-     * Compute and print the performance index
+     * Compute and print the performance index of each allocator. The
+     * autoresult string describes the last one, which is mm unless -a
+     * says otherwise.
      */
-    if (errors == 0) {
-        if(perf_weight == 0) {
-            avg_mm_throughput = 0;
-        }
-        else {
-            avg_mm_throughput = (secs == 0) ? 0 : ops/secs;
-        }
+    for (b = 0; b < nbackends; b++) {
+        mm_stats = all_stats + b * num_tracefiles;
 
-#ifdef ALT_GRADING
-        if (avg_mm_throughput < MIN_SPEED) {
-            p2 = 0.0;
-        } else if (avg_mm_throughput > MAX_SPEED) {
-            p2 = 1.0;
-        } else {
-            p2 = (avg_mm_throughput - MIN_SPEED) / (MAX_SPEED - MIN_SPEED);
+        numcorrect = 0;
+        for (i=0; i < num_tracefiles; i++) {
+            if (mm_stats[i].valid)
+                numcorrect++;
         }
 
-        if (avg_mm_util < MIN_SPACE) {
-            p1 = 0.0;
-        } else if (avg_mm_util > MAX_SPACE) {
-            p1 = 1.0;
-        } else {
-            p1 = (avg_mm_util - MIN_SPACE) / (MAX_SPACE - MIN_SPACE);
-        }
+        if (nbackends > 1)
+            printf("%s: ", backends[b]->name);
 
-        perfindex = p1 < p2 ? p1 * 100.0 : p2 * 100.0; 
-        if(perfindex < 0.0) perfindex = 0.0;
-        if(perfindex > 100.0) perfindex = 100.0;
-#else
-        if (avg_mm_util < MIN_SPACE) {
-            p1 = 0.0;
-        } else if (avg_mm_util > MAX_SPACE) {
-            p1 = UTIL_WEIGHT;
-        } else {
-            p1 = (avg_mm_util - MIN_SPACE) / (MAX_SPACE - MIN_SPACE) * UTIL_WEIGHT;
+        if (backend_errors[b] == 0) {
+            index = perfindex(num_tracefiles, mm_stats, &avg_mm_util,
+                              &avg_mm_throughput, &p1, &p2);
+            printf("Perf index = %.0f (util) & %.0f (thru) = %.0f/100\n",
+                   p1*100,
+                   p2*100,
+                   index);
         }
-
-        if (avg_mm_throughput < MIN_SPEED) {
-            p2 = 0.0;
-        } else if (avg_mm_throughput > MAX_SPEED) {
-            p2 = 1.0 - UTIL_WEIGHT;
-        } else {
-            p2 = (avg_mm_throughput - MIN_SPEED) / (MAX_SPEED - MIN_SPEED) * (1.0 - UTIL_WEIGHT);
+        else { /* There were errors */
+            index = 0.0;
+            avg_mm_util = 0;
+            avg_mm_throughput = 0;
+            printf("Terminated with %d errors\n", backend_errors[b]);
         }
 
-        perfindex = (p1 + p2)*100.0;
-#endif
-
-
-        printf("Perf index = %.0f (util) & %.0f (thru) = %.0f/100\n",
-               p1*100,
-               p2*100,
-               perfindex);
-
-    }
-    else { /* There were errors */
-        perfindex = 0.0;
-        printf("Terminated with %d errors\n", errors);
+        perf = index;
+        auto_util = avg_mm_util;
+        auto_throughput = avg_mm_throughput;
     }
 
     /* Optionally emit autoresult string */
     if (autograder) {
         sprintf(autoresult, "%d:%.0f:%.0f:%.0f",
-                numcorrect, (float)perfindex, 
-                avg_mm_throughput/1000.0, avg_mm_util*100);
+                numcorrect, (float)perf, 
+                auto_throughput/1000.0, auto_util*100);
         printf("\nAUTORESULT_STRING=%s\n", autoresult);
     }
 
+    if (frag_file)
+        fclose(frag_file);
+
+    if (resultfile)
+        write_results(resultfile, nbackends * num_tracefiles, all_stats);
+
+    if (basefile) {
+        regressions = compare_results(nbackends * num_tracefiles, all_stats,
+                                      basefile, confidence);
+        if (regressions > 0) {
+            printf("%d trace%s regressed against %s\n", regressions,
+                   regressions > 1 ? "s" : "", basefile);
+            exit(1);
+        }
+    }
+
     exit(0);
 }
 
@@ -562,9 +820,25 @@ static int add_range(range_t **ranges, char *lo, int size,
 {
     char *hi = lo + size - 1;
     range_t *p;
+    size_t usable;
 
     assert(size > 0);
 
+    /* All of the usable size is the caller's, so it must cover the
+       request and is what mustn't overlap */
+    if (mm->usable_size != NULL &&
+        !(use_regions && trace->ops[opnum].region >= 0) &&
+        !(use_pools && trace->ops[opnum].pool >= 0)) {
+        usable = mm->usable_size(lo);
+        if (usable < (size_t)size) {
+            malloc_error(trace, opnum,
+                         "Usable size %zu of payload %p is less than %d",
+                         usable, lo, size);
+            return 0;
+        }
+        hi = lo + usable - 1;
+    }
+
     /* Payload addresses must be ALIGNMENT-byte aligned */
     if (!IS_ALIGNED(lo)) {
         malloc_error(trace, opnum,
@@ -572,9 +846,20 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* ... or aligned as asked, for an 'm' request */
+    if (trace->ops[opnum].align > 0 &&
+        (unsigned long)lo % trace->ops[opnum].align != 0) {
+        malloc_error(trace, opnum,
+                     "Payload address (%p) not aligned to %zu bytes",
+                     lo, trace->ops[opnum].align);
+        return 0;
+    }
+
+    /* The payload must lie within the extent of the heap, unless the
+       allocator doesn't get its memory from memlib */
+    if (mm->heapsize == NULL &&
+        ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi()))) {
         malloc_error(trace, opnum,
                      "Payload (%p:%p) lies outside heap (%p:%p)",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
@@ -711,6 +996,23 @@ static void check_index(const trace_t *trace, int opnum, int index) {
  * The following routines manipulate tracefiles
  *********************************************/
 
+/*
+ * same_run - Whether request next, which follows op in the trace, can
+ *     be made in the same batch call as op (-b)
+ */
+static int same_run(const traceop_t *op, const traceop_t *next)
+{
+    if (op->pool >= 0 || next->pool >= 0)
+        return 0;
+    if (op->type == ALLOC)
+        return next->type == ALLOC && next->size == op->size &&
+            op->align == 0 && next->align == 0 &&
+            op->region < 0 && next->region < 0 &&
+            op->hint == MM_HINT_UNKNOWN && next->hint == MM_HINT_UNKNOWN;
+    return op->type == FREE && next->type == FREE &&
+        op->index >= 0 && next->index >= 0;
+}
+
 /*
  * read_trace - read a trace file and store it in memory
  */
@@ -719,10 +1021,13 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 {
     FILE *tracefile;
     trace_t *trace;
+    traceop_t *op;
     char type[MAXLINE];
-    int index, size;
+    int index, size, align, region, pool;
     int max_index = 0;
-    int op_index;
+    int op_index, n;
+    int thread;
+    int *last_op, *next_op, *pool_size;
 
     if (verbose > 1)
         printf("Reading tracefile: %s\n", filename);
@@ -769,42 +1074,225 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
          calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
         unix_error("malloc 5 failed in read_trace");
 
+    /* and the live set for payload touching */
+    if ((trace->live_ids =
+         calloc(trace->num_ids, sizeof(*trace->live_ids))) == NULL)
+        unix_error("malloc 6 failed in read_trace");
+    if ((trace->live_pos =
+         calloc(trace->num_ids, sizeof(*trace->live_pos))) == NULL)
+        unix_error("malloc 7 failed in read_trace");
+    trace->num_live = 0;
+
+    /* the blocks of each region, chained through region_next */
+    if ((trace->region_next =
+         calloc(trace->num_ids, sizeof(*trace->region_next))) == NULL)
+        unix_error("malloc 9 failed in read_trace");
+
+    /* the last request on each block, to order cross-thread requests */
+    if ((last_op = malloc(trace->num_ids * sizeof(int))) == NULL)
+        unix_error("malloc 8 failed in read_trace");
+    memset(last_op, -1, trace->num_ids * sizeof(int));
+    trace->num_threads = 1;
+    trace->num_aligned = 0;
+    trace->num_regions = 0;
+    trace->num_pools = 0;
+    stats->reallocs = 0;
 
-    /* read every request line in the trace file */
+
+    /*
+     * read every request line in the trace file. In a multi-threaded
+     * trace a request may start with the id of the thread that makes
+     * it, as in "2: a 17 512"; requests without one are on thread 0.
+     * "m <id> <size> <align>" allocates with a payload aligned to align.
+     * "x <region> <id> <size>" allocates from a region, and "z <region>"
+     * resets it, freeing every block allocated from it since.
+     * "p <pool> <id> <size>" gets an object from a pool, and a free of
+     * the object puts it back.
+     */
     index = 0;
     op_index = 0;
     while (fscanf(tracefile, "%s", type) != EOF) {
+        thread = 0;
+        region = -1;
+        pool = -1;
+        if (type[strlen(type)-1] == ':') {
+            thread = atoi(type);
+            if (thread < 0 || fscanf(tracefile, "%s", type) == EOF)
+                app_error("Bad thread id in tracefile %s\n", trace->filename);
+            if (thread >= trace->num_threads)
+                trace->num_threads = thread + 1;
+        }
         switch(type[0]) {
         case 'a':
             fscanf(tracefile, "%u %u", &index, &size);
             trace->ops[op_index].type = ALLOC;
             trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
+            trace->ops[op_index].align = 0;
+            max_index = (index > max_index) ? index : max_index;
+            break;
+        case 'm':
+            fscanf(tracefile, "%u %u %u", &index, &size, &align);
+            if (align == 0 || (align & (align - 1)) != 0)
+                app_error("Bad alignment %u in tracefile %s\n",
+                          align, trace->filename);
+            trace->ops[op_index].type = ALLOC;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            trace->ops[op_index].align = align;
+            trace->num_aligned++;
             max_index = (index > max_index) ? index : max_index;
             break;
         case 'r':
             fscanf(tracefile, "%u %u", &index, &size);
             trace->ops[op_index].type = REALLOC;
+            stats->reallocs++;
             trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
+            trace->ops[op_index].align = 0;
             max_index = (index > max_index) ? index : max_index;
             break;
         case 'f':
             fscanf(tracefile, "%ud", &index);
             trace->ops[op_index].type = FREE;
             trace->ops[op_index].index = index;
+            trace->ops[op_index].align = 0;
+            break;
+        case 'x':
+            fscanf(tracefile, "%u %u %u", &region, &index, &size);
+            trace->ops[op_index].type = ALLOC;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            trace->ops[op_index].align = 0;
+            max_index = (index > max_index) ? index : max_index;
+            break;
+        case 'p':
+            fscanf(tracefile, "%u %u %u", &pool, &index, &size);
+            trace->ops[op_index].type = ALLOC;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            trace->ops[op_index].align = 0;
+            max_index = (index > max_index) ? index : max_index;
+            break;
+        case 'z':
+            fscanf(tracefile, "%u", &region);
+            trace->ops[op_index].type = RESET;
+            trace->ops[op_index].index = index = -1;
+            trace->ops[op_index].align = 0;
             break;
         default:
             app_error("Bogus type character (%c) in tracefile %s\n",
                       type[0], trace->filename);
         }
+        trace->ops[op_index].thread = thread;
+        trace->ops[op_index].region = region;
+        trace->ops[op_index].pool = pool;
+        trace->ops[op_index].hint = MM_HINT_UNKNOWN;
+        if ((region >= 0 || pool >= 0) && thread != 0)
+            app_error("Region or pool request on thread %d in tracefile %s\n",
+                      thread, trace->filename);
+        if (region >= trace->num_regions)
+            trace->num_regions = region + 1;
+        if (pool >= trace->num_pools)
+            trace->num_pools = pool + 1;
+        trace->ops[op_index].dep = -1;
+        trace->ops[op_index].batch = 0;
+        if (index >= 0 && index < trace->num_ids) {
+            /* Blocks of a region are only ever freed by its reset */
+            if (last_op[index] >= 0 &&
+                trace->ops[last_op[index]].region >= 0 &&
+                trace->ops[op_index].type != ALLOC)
+                app_error("Block %d of a region is freed in tracefile %s\n",
+                          index, trace->filename);
+            /* ... and an object of a pool only by a free */
+            if (last_op[index] >= 0 &&
+                trace->ops[last_op[index]].pool >= 0) {
+                if (trace->ops[op_index].type == REALLOC)
+                    app_error("Block %d of a pool is reallocated in "
+                              "tracefile %s\n", index, trace->filename);
+                if (trace->ops[op_index].type == FREE)
+                    trace->ops[op_index].pool = trace->ops[last_op[index]].pool;
+            }
+            trace->ops[op_index].dep = last_op[index];
+            last_op[index] = op_index;
+        }
         op_index++;
         if(op_index == trace->num_ops) break;
     }
     fclose(tracefile);
+    free(last_op);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
 
+    /* The objects of a pool all have the size of its first one */
+    if ((pool_size = calloc(trace->num_pools + 1, sizeof(int))) == NULL)
+        unix_error("malloc 12 failed in read_trace");
+    for (op_index = 0; op_index < trace->num_ops; op_index++) {
+        op = &trace->ops[op_index];
+        if (op->type != ALLOC || op->pool < 0)
+            continue;
+        if (pool_size[op->pool] == 0)
+            pool_size[op->pool] = op->size;
+        else if (pool_size[op->pool] != (int)op->size)
+            app_error("Pool %d gets objects of %d and %zu bytes in "
+                      "tracefile %s\n", op->pool, pool_size[op->pool],
+                      op->size, trace->filename);
+    }
+    free(pool_size);
+
+    /* Oracle lifetime hints: a block lives until the next request on
+       it, which a backward pass finds in next_op */
+    if (hint_lifetime > 0) {
+        if ((next_op = malloc(trace->num_ids * sizeof(int))) == NULL)
+            unix_error("malloc 11 failed in read_trace");
+        for (index = 0; index < trace->num_ids; index++)
+            next_op[index] = trace->num_ops;
+        for (op_index = trace->num_ops - 1; op_index >= 0; op_index--) {
+            index = trace->ops[op_index].index;
+            if (index < 0)
+                continue;
+            if (trace->ops[op_index].type == ALLOC &&
+                trace->ops[op_index].region < 0 &&
+                trace->ops[op_index].pool < 0)
+                trace->ops[op_index].hint =
+                    next_op[index] - op_index > hint_lifetime ?
+                    MM_HINT_LONG : MM_HINT_SHORT;
+            next_op[index] = op_index;
+        }
+        free(next_op);
+    }
+
+    /* Runs of plain mallocs of one size, and runs of frees, are made
+       in one call: a malloc run by its first request, which hands out
+       the blocks of the others, and a free run by its last, once the
+       blocks of the others have been checked. Only single-threaded
+       traces have runs, so no other thread waits on their blocks. */
+    if (batch_calls && trace->num_threads == 1) {
+        for (op_index = 0; op_index < trace->num_ops; op_index += n) {
+            op = &trace->ops[op_index];
+            for (n = 1; n < BATCH_MAX && op_index + n < trace->num_ops &&
+                     same_run(op, &trace->ops[op_index + n]); n++)
+                trace->ops[op_index + n].batch = -1;
+            if (n == 1)
+                continue;
+            if (op->type == ALLOC)
+                op->batch = n;
+            else {
+                op->batch = -1;
+                trace->ops[op_index + n - 1].batch = n;
+            }
+        }
+    }
+
+    if ((trace->regions = calloc(trace->num_regions + 1,
+                                 sizeof(*trace->regions))) == NULL ||
+        (trace->region_head = calloc(trace->num_regions + 1,
+                                     sizeof(*trace->region_head))) == NULL)
+        unix_error("malloc 10 failed in read_trace");
+    if ((trace->pools = calloc(trace->num_pools + 1,
+                               sizeof(*trace->pools))) == NULL)
+        unix_error("malloc 13 failed in read_trace");
+
     /* fill in the stats */
     strcpy(stats->filename, trace->filename);
     stats->weight = trace->weight;
@@ -821,10 +1309,17 @@ static void reinit_trace(trace_t *trace)
     memset(trace->blocks, 0, trace->num_ids * sizeof(*trace->blocks));
     memset(trace->block_sizes, 0, trace->num_ids * sizeof(*trace->block_sizes));
     /* block_rand_base is unused if size is zero */
+    trace->num_live = 0;
+    /* regions lived in the allocator's old heap */
+    memset(trace->regions, 0, trace->num_regions * sizeof(*trace->regions));
+    memset(trace->region_head, -1,
+           trace->num_regions * sizeof(*trace->region_head));
+    /* ... and so did pools */
+    memset(trace->pools, 0, trace->num_pools * sizeof(*trace->pools));
 }
 
 /*
- * free_trace - Free the trace record and the four arrays it points
+ * free_trace - Free the trace record and the six arrays it points
  *              to, all of which were allocated in read_trace().
  */
 static void free_trace(trace_t *trace)
@@ -833,6 +1328,12 @@ static void free_trace(trace_t *trace)
     free(trace->blocks);
     free(trace->block_sizes);
     free(trace->block_rand_base);
+    free(trace->live_ids);
+    free(trace->live_pos);
+    free(trace->regions);
+    free(trace->region_head);
+    free(trace->region_next);
+    free(trace->pools);
     free(trace);              /* and the trace record itself... */
 }
 
@@ -841,6 +1342,117 @@ static void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * trace_alloc - Make the allocation request op: mm_memalign for an 'm'
+ *     request, mm_region_alloc for an 'x' request and mm_pool_get for a
+ *     'p' request if the allocator has regions and pools,
+ *     mm_malloc_batch for a run of mallocs with -b, and mm_malloc
+ *     otherwise
+ */
+static void *trace_alloc(trace_t *trace, const traceop_t *op)
+{
+    mm_region_t **r;
+    mm_pool_t **pl;
+    void *out[BATCH_MAX];
+    int i, n;
+
+    if (op->batch != 0 && mm->malloc_batch != NULL) {
+        /* The first request of the run allocates for the others */
+        if (op->batch < 0)
+            return trace->blocks[op->index];
+        n = mm->malloc_batch(op->size, op->batch, out);
+        for (i = 0; i < op->batch; i++)
+            trace->blocks[op[i].index] =
+                i < n ? out[i] : mm->malloc(op->size);
+        return trace->blocks[op->index];
+    }
+    if (op->align > 0)
+        return mm->memalign(op->align, op->size);
+    if (op->pool >= 0 && use_pools) {
+        pl = &trace->pools[op->pool];
+        if (*pl == NULL && (*pl = mm->pool_create(op->size, 0)) == NULL)
+            return NULL;
+        return mm->pool_get(*pl);
+    }
+    if (op->region < 0) {
+        if (op->hint != MM_HINT_UNKNOWN && mm->malloc_hint != NULL)
+            return mm->malloc_hint(op->size, op->hint);
+        return mm->malloc(op->size);
+    }
+
+    trace->region_next[op->index] = trace->region_head[op->region];
+    trace->region_head[op->region] = op->index;
+    if (!use_regions)
+        return mm->malloc(op->size);
+    r = &trace->regions[op->region];
+    if (*r == NULL && (*r = mm->region_create(0)) == NULL)
+        return NULL;
+    return mm->region_alloc(*r, op->size);
+}
+
+/*
+ * trace_free - Make the free request op of block p: mm_pool_put for
+ *     an object of a pool if the allocator has pools; with -b, the last
+ *     free of a run frees the blocks of the whole run with
+ *     mm_free_batch, and other frees go to mm_free_sized
+ */
+static void trace_free(trace_t *trace, const traceop_t *op, void *p)
+{
+    void *ptrs[BATCH_MAX];
+    int i;
+
+    if (op->pool >= 0 && use_pools)
+        mm->pool_put(trace->pools[op->pool], p);
+    else if (op->batch != 0 && mm->free_batch != NULL) {
+        if (op->batch < 0)
+            return;
+        for (i = 0; i < op->batch; i++)
+            ptrs[i] = trace->blocks[op[i - op->batch + 1].index];
+        mm->free_batch(ptrs, op->batch);
+    }
+    else if (batch_calls && mm->free_sized != NULL && op->dep >= 0 &&
+             trace->ops[op->dep].align == 0)
+        mm->free_sized(p, trace->ops[op->dep].size);
+    else
+        mm->free(p);
+}
+
+/*
+ * trace_reset - Reset the region of request op, with mm_region_reset
+ *     or by freeing each of its blocks. Callers that track blocks walk
+ *     region_head and region_next first.
+ */
+static void trace_reset(trace_t *trace, const traceop_t *op)
+{
+    int index;
+
+    if (use_regions) {
+        if (trace->regions[op->region] != NULL)
+            mm->region_reset(trace->regions[op->region]);
+    }
+    else {
+        for (index = trace->region_head[op->region]; index >= 0;
+             index = trace->region_next[index])
+            mm->free(trace->blocks[index]);
+    }
+    trace->region_head[op->region] = -1;
+}
+
+/*
+ * trace_destroy_pools - Give back the pools of the trace, with any
+ *     objects still out of them
+ */
+static void trace_destroy_pools(trace_t *trace)
+{
+    int i;
+
+    for (i = 0; i < trace->num_pools; i++)
+        if (trace->pools[i] != NULL) {
+            mm->pool_destroy(trace->pools[i]);
+            trace->pools[i] = NULL;
+        }
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
@@ -859,11 +1471,17 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
     reinit_trace(trace);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (mm->init() < 0) {
         malloc_error(trace, 0, "mm_init failed.");
         return 0;
     }
 
+    if (trace->num_aligned > 0 && mm->memalign == NULL) {
+        malloc_error(trace, 0, "%s has no memalign for 'm' requests.",
+                     mm->name);
+        return 0;
+    }
+
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
         index = trace->ops[i].index;
@@ -873,7 +1491,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             range_t *r;
                         
             /* Let the students check their own heap */
-            mm_checkheap(verbose);
+            mm->checkheap(verbose);
 
             /* Now check that all our allocated blocks have the right data */
             r = *ranges;
@@ -888,7 +1506,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
+            if ((p = trace_alloc(trace, &trace->ops[i])) == NULL) {
                 malloc_error(trace, i, "mm_malloc failed.");
                 return 0;
             }
@@ -914,7 +1532,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 
             /* Call the student's realloc */
             oldp = trace->blocks[index];
-            newp = mm_realloc(oldp, size);
+            newp = mm->realloc(oldp, size);
             if( (newp == NULL) && (size != 0) ) {
                 malloc_error(trace, i, "mm_realloc failed.");
                 return 0;
@@ -959,7 +1577,16 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
                 p = trace->blocks[index];
                 remove_range(ranges, p);
             }
-            mm_free(p);
+            trace_free(trace, &trace->ops[i], p);
+            break;
+
+        case RESET: /* mm_region_reset */
+            for (index = trace->region_head[trace->ops[i].region];
+                 index >= 0; index = trace->region_next[index]) {
+                check_index(trace, i, index);
+                remove_range(ranges, trace->blocks[index]);
+            }
+            trace_reset(trace, &trace->ops[i]);
             break;
 
         default:
@@ -968,6 +1595,11 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 
     }
 
+    /* The pools' slabs, full ones included, go back to the heap */
+    trace_destroy_pools(trace);
+    if (debug_mode == DBG_EXPENSIVE)
+        mm->checkheap(verbose);
+
     /* As far as we know, this is a valid malloc package */
     return 1;
 }
@@ -980,25 +1612,30 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  *   size of the heap in bytes after running the student's malloc
  *   package on the trace. Note that our implementation of mem_sbrk()
  *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   is always the high water mark of the heap. Allocators with their
+ *   own heap size query are measured against the largest size it
+ *   reports during the trace instead.
  *
- *   A higher number is better: 1 is optimal.
+ *   A higher number is better: 1 is optimal. Reallocs that return the
+ *   same block are counted in *inplace.
  */
-static double eval_mm_util(trace_t *trace, int tracenum)
+static double eval_mm_util(trace_t *trace, int tracenum, int *inplace)
 {
     int i;
     int index;
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
+    size_t heapsize, max_heapsize = 0;
     char *p;
     char *newp, *oldp;
 
     reinit_trace(trace);
+    *inplace = 0;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (mm->init() < 0)
         app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -1008,7 +1645,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL) {
+            if ((p = trace_alloc(trace, &trace->ops[i])) == NULL) {
                 app_error("trace %d: mm_malloc failed in eval_mm_util",
                           tracenum);
             }
@@ -1026,10 +1663,12 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             oldsize = trace->block_sizes[index];
 
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0) {
+            if ((newp = mm->realloc(oldp,newsize)) == NULL && newsize != 0) {
                 app_error("trace %d: mm_realloc failed in eval_mm_util",
                           tracenum);
             }
+            if (newp == oldp && oldp != NULL)
+                (*inplace)++;
 
             /* Remember region and size */
             trace->blocks[index] = newp;
@@ -1048,11 +1687,18 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                 p = trace->blocks[index];
             }
 
-            mm_free(p);
+            trace_free(trace, &trace->ops[i], p);
 
             total_size -= size;
             break;
 
+        case RESET: /* mm_region_reset */
+            for (index = trace->region_head[trace->ops[i].region];
+                 index >= 0; index = trace->region_next[index])
+                total_size -= trace->block_sizes[index];
+            trace_reset(trace, &trace->ops[i]);
+            break;
+
         default:
             app_error("trace %d: Nonexistent request type in eval_mm_util",
                       tracenum);
@@ -1061,11 +1707,48 @@ static double eval_mm_util(trace_t *trace, int tracenum)
         /* update the high-water mark */
         max_total_size = (total_size > max_total_size) ?
             total_size : max_total_size;
+
+        if (mm->heapsize) {
+            heapsize = mm->heapsize();
+            max_heapsize = (heapsize > max_heapsize) ? heapsize : max_heapsize;
+        }
+
+        if (frag_file &&
+            ((i % frag_interval) == 0 || i == trace->num_ops - 1))
+            sample_frag(trace, i, total_size);
     }
 
     printf(".");
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    if (mm->heapsize == NULL)
+        max_heapsize = mem_heapsize();
+    return (max_heapsize == 0) ? 0 :
+        ((double)max_total_size / (double)max_heapsize);
+}
+
+
+/*
+ * sample_frag - Append one row to the fragmentation time series: the
+ *   heap size, the live payload bytes the trace has asked for, how
+ *   the rest of the heap is split between free blocks, and the
+ *   internal fragmentation (allocated block bytes beyond the payload).
+ *   The last three are left empty for allocators that can't report them.
+ */
+static void sample_frag(const trace_t *trace, int opnum, int live_bytes)
+{
+    mm_heapstats_t hs;
+
+    fprintf(frag_file, "%s,%s,%d,%zu,%d,", mm->name, trace->filename, opnum,
+            mm->heapsize ? mm->heapsize() : mem_heapsize(), live_bytes);
+    if (mm->heapstats) {
+        mm->heapstats(&hs);
+        fprintf(frag_file, "%zu,%zu,%zu,%zu,%zu\n", hs.free_bytes,
+                hs.largest_free, hs.alloc_bytes > (size_t)live_bytes ?
+                hs.alloc_bytes - live_bytes : 0,
+                hs.dirty_bytes, hs.purged_bytes);
+    }
+    else
+        fprintf(frag_file, ",,,,\n");
 }
 
 
@@ -1075,14 +1758,15 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, index, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
     reinit_trace(trace);
+    ((speed_t *)ptr)->inplace = 0;
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (mm->init() < 0)
         app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
@@ -1091,8 +1775,7 @@ static void eval_mm_speed(void *ptr)
 
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = trace_alloc(trace, &trace->ops[i])) == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -1101,8 +1784,10 @@ static void eval_mm_speed(void *ptr)
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
+            if ((newp = mm->realloc(oldp,newsize)) == NULL && newsize != 0)
                 app_error("mm_realloc error in eval_mm_speed");
+            if (newp == oldp && oldp != NULL)
+                ((speed_t *)ptr)->inplace++;
             trace->blocks[index] = newp;
             break;
 
@@ -1113,7 +1798,11 @@ static void eval_mm_speed(void *ptr)
             } else {
                 block = trace->blocks[index];
             }
-            mm_free(block);
+            trace_free(trace, &trace->ops[i], block);
+            break;
+
+        case RESET: /* mm_region_reset */
+            trace_reset(trace, &trace->ops[i]);
             break;
 
         default:
@@ -1122,98 +1811,281 @@ static void eval_mm_speed(void *ptr)
 }
 
 /*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
+ * Multi-threaded replay. Each trace thread is replayed on replay thread
+ * (trace thread % nthreads), in trace order. A request on a block that
+ * was last touched by another replay thread, such as a free of a block
+ * malloc'ed elsewhere, first waits for that request to be done.
  */
-static int eval_libc_valid(trace_t *trace)
-{
-    int i, newsize;
-    char *p, *newp, *oldp;
+typedef struct {
+    trace_t *trace;
+    int *ops;                 /* the requests this thread replays... */
+    int nops;                 /* ... and how many there are */
+    volatile char *done;      /* which requests are done, for all threads */
+    pthread_barrier_t *start; /* so that all threads start together */
+    struct timespec t0, t1;   /* when this thread started and finished */
+} replay_t;
 
-    reinit_trace(trace);
+/* Seconds from a to b */
+#define TS_SECS(a, b) \
+    (((b).tv_sec - (a).tv_sec) + ((b).tv_nsec - (a).tv_nsec) / 1e9)
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
-
-        case ALLOC: /* malloc */
-            if ((p = malloc(trace->ops[i].size)) == NULL) {
-                malloc_error(trace, i, "libc malloc failed");
-                unix_error("System message");
-            }
-            trace->blocks[trace->ops[i].index] = p;
+/*
+ * replay_thread - replay one thread's share of a trace
+ */
+static void *replay_thread(void *arg)
+{
+    replay_t *r = arg;
+    trace_t *trace = r->trace;
+    traceop_t *op;
+    char *p;
+    int i, spins;
+
+    pthread_barrier_wait(r->start);
+    clock_gettime(CLOCK_MONOTONIC, &r->t0);
+    for (i = 0; i < r->nops; i++) {
+        op = &trace->ops[r->ops[i]];
+        for (spins = 0; op->dep >= 0 &&
+                 !__atomic_load_n(&r->done[op->dep], __ATOMIC_ACQUIRE); spins++)
+            if (spins > 100)
+                sched_yield();
+
+        switch (op->type) {
+        case ALLOC:
+            if ((p = trace_alloc(trace, op)) == NULL)
+                app_error("mm_malloc error in eval_mm_threads");
+            trace->blocks[op->index] = p;
             break;
-
-        case REALLOC: /* realloc */
-            newsize = trace->ops[i].size;
-            oldp = trace->blocks[trace->ops[i].index];
-            if ((newp = realloc(oldp, newsize)) == NULL && newsize != 0) {
-                malloc_error(trace, i, "libc realloc failed");
-                unix_error("System message");
-            }
-            trace->blocks[trace->ops[i].index] = newp;
+        case REALLOC:
+            p = mm->realloc(trace->blocks[op->index], op->size);
+            if (p == NULL && op->size != 0)
+                app_error("mm_realloc error in eval_mm_threads");
+            trace->blocks[op->index] = p;
             break;
-
-        case FREE: /* free */
-            if(trace->ops[i].index >= 0) {
-                free(trace->blocks[trace->ops[i].index]);
-            } else {
-                free(0);
-            }
+        case FREE:
+            trace_free(trace, op,
+                       op->index < 0 ? NULL : trace->blocks[op->index]);
             break;
+        case RESET:
+            trace_reset(trace, op);
+            break;
+        }
+        __atomic_store_n(&r->done[r->ops[i]], 1, __ATOMIC_RELEASE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &r->t1);
+    return NULL;
+}
 
-        default:
-            app_error("invalid operation type  in eval_libc_valid");
+/*
+ * eval_mm_threads - replay the trace on 1, 2, 4 ... threads, up to
+ *    max_threads or the number of trace threads, keeping the fastest
+ *    of THREAD_RUNS runs at each thread count. Allocators that aren't
+ *    thread-safe only get the single-threaded run.
+ */
+static void eval_mm_threads(trace_t *trace, stats_t *stats)
+{
+    replay_t r[MAXTHREADS];
+    pthread_t tid[MAXTHREADS];
+    pthread_barrier_t start;
+    char *done;
+    int *ops;
+    int limit, nthreads, run, t, i, k;
+    struct timespec t0, t1;
+    double secs, tsecs;
+
+    limit = trace->num_threads < max_threads ? trace->num_threads : max_threads;
+    if (!mm->threadsafe)
+        limit = 1;
+    if ((done = malloc(trace->num_ops)) == NULL ||
+        (ops = malloc(trace->num_ops * sizeof(int))) == NULL)
+        unix_error("malloc failed in eval_mm_threads");
+
+    stats->nsweep = 0;
+    for (nthreads = 1; stats->nsweep < MAXSWEEP;
+         nthreads = (nthreads*2 < limit) ? nthreads*2 : limit) {
+
+        /* Deal the requests out to the replay threads */
+        for (t = 0, k = 0; t < nthreads; t++) {
+            r[t].trace = trace;
+            r[t].ops = ops + k;
+            r[t].done = done;
+            r[t].start = &start;
+            for (i = 0; i < trace->num_ops; i++)
+                if (trace->ops[i].thread % nthreads == t)
+                    ops[k++] = i;
+            r[t].nops = ops + k - r[t].ops;
+        }
+
+        k = stats->nsweep++;
+        stats->sweep_threads[k] = nthreads;
+        stats->sweep_secs[k] = 0;
+        for (run = 0; run < THREAD_RUNS; run++) {
+            reinit_trace(trace);
+            memset(done, 0, trace->num_ops);
+            mem_reset_brk();
+            if (mm->init() < 0)
+                app_error("mm_init failed in eval_mm_threads");
+
+            pthread_barrier_init(&start, NULL, nthreads);
+            for (t = 0; t < nthreads; t++)
+                if (pthread_create(&tid[t], NULL, replay_thread, &r[t]) != 0)
+                    unix_error("pthread_create failed in eval_mm_threads");
+            for (t = 0; t < nthreads; t++)
+                pthread_join(tid[t], NULL);
+            pthread_barrier_destroy(&start);
+
+            /* The replay takes the wall-clock time from the earliest
+               start of any thread to the latest end, not the longest
+               any one thread ran: threads that share a CPU each run
+               for only part of their span */
+            t0 = r[0].t0;
+            t1 = r[0].t1;
+            for (t = 1; t < nthreads; t++) {
+                if (TS_SECS(r[t].t0, t0) > 0)
+                    t0 = r[t].t0;
+                if (TS_SECS(t1, r[t].t1) > 0)
+                    t1 = r[t].t1;
+            }
+            secs = TS_SECS(t0, t1);
+
+            if (run == 0 || secs < stats->sweep_secs[k]) {
+                stats->sweep_secs[k] = secs;
+                for (t = 0; t < nthreads; t++) {
+                    tsecs = TS_SECS(r[t].t0, r[t].t1);
+                    stats->sweep_kops[k][t] = tsecs > 0 ?
+                        (r[t].nops/1e3)/tsecs : 0;
+                }
+            }
         }
+        if (nthreads == limit)
+            break;
     }
 
-    return 1;
+    free(done);
+    free(ops);
 }
 
 /*
- * eval_libc_speed - This is the function that is used by fcyc() to
- *    measure the running time of the libc malloc package on the set
- *    of traces.
+ * live_add, live_remove - keep track of which blocks are live, so that
+ *    eval_mm_speed_touch can pick live blocks to read in constant time
  */
-static void eval_libc_speed(void *ptr)
+static void live_add(trace_t *trace, int index)
 {
-    int i;
-    int index, size, newsize;
+    trace->live_pos[index] = trace->num_live;
+    trace->live_ids[trace->num_live++] = index;
+}
+
+static void live_remove(trace_t *trace, int index)
+{
+    int last = trace->live_ids[--trace->num_live];
+
+    trace->live_ids[trace->live_pos[index]] = last;
+    trace->live_pos[last] = trace->live_pos[index];
+}
+
+/*
+ * touch_read - read one byte from every cache line of a block
+ */
+static void touch_read(const char *p, size_t size)
+{
+    unsigned sum = 0;
+    size_t i;
+
+    if (size == 0)
+        return;
+    for (i = 0; i < size; i += CACHE_LINE)
+        sum += p[i];
+    touch_sink += sum + p[size-1];
+}
+
+/*
+ * eval_mm_speed_touch - Like eval_mm_speed, but models an application
+ *    that uses the memory it gets: every new block is written in full,
+ *    a realloc'd block has its new tail written (the allocator has
+ *    already copied the rest), and after every request touch_fraction
+ *    of the live blocks, chosen pseudo-randomly, are read. The choice
+ *    only depends on the trace, so every allocator sees the same reads
+ *    and the throughput difference reflects where blocks were placed.
+ */
+static void eval_mm_speed_touch(void *ptr)
+{
+    int i, index, size, newsize, oldsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    unsigned rand_state = 1;
+    double reads = 0;
 
     reinit_trace(trace);
+    ((speed_t *)ptr)->inplace = 0;
 
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm->init() < 0)
+        app_error("mm_init failed in eval_mm_speed_touch");
+
+    /* Interpret each trace request */
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
-        case ALLOC: /* malloc */
+
+        case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = malloc(size)) == NULL)
-                unix_error("malloc failed in eval_libc_speed");
+            if ((p = trace_alloc(trace, &trace->ops[i])) == NULL)
+                app_error("mm_malloc error in eval_mm_speed_touch");
+            memset(p, index, size);
             trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            live_add(trace, index);
             break;
 
-        case REALLOC: /* realloc */
+        case REALLOC: /* mm_realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
+            oldsize = trace->block_sizes[index];
             oldp = trace->blocks[index];
-            if ((newp = realloc(oldp, newsize)) == NULL && newsize != 0)
-                unix_error("realloc failed in eval_libc_speed\n");
-
+            if ((newp = mm->realloc(oldp,newsize)) == NULL && newsize != 0)
+                app_error("mm_realloc error in eval_mm_speed_touch");
+            if (newp == oldp && oldp != NULL)
+                ((speed_t *)ptr)->inplace++;
+            if (newsize > oldsize)
+                memset(newp + oldsize, index, newsize - oldsize);
+            if (oldp == NULL && newsize != 0)
+                live_add(trace, index);
+            else if (oldp != NULL && newsize == 0)
+                live_remove(trace, index);
             trace->blocks[index] = newp;
+            trace->block_sizes[index] = newsize;
             break;
 
-        case FREE: /* free */
+        case FREE: /* mm_free */
             index = trace->ops[i].index;
-            if(index >= 0) {
-                block = trace->blocks[index];
-                free(block);
+            if(index < 0) {
+                block = 0;
             } else {
-                free(0);
+                block = trace->blocks[index];
+                if (block != NULL)
+                    live_remove(trace, index);
             }
+            trace_free(trace, &trace->ops[i], block);
+            break;
+
+        case RESET: /* mm_region_reset */
+            for (index = trace->region_head[trace->ops[i].region];
+                 index >= 0; index = trace->region_next[index])
+                live_remove(trace, index);
+            trace_reset(trace, &trace->ops[i]);
             break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_speed_touch");
+        }
+
+        /* Read a share of the live blocks between requests */
+        reads += touch_fraction * trace->num_live;
+        while (reads >= 1 && trace->num_live > 0) {
+            rand_state = rand_state * 1103515245 + 12345;
+            index = trace->live_ids[(rand_state >> 8) % trace->num_live];
+            touch_read(trace->blocks[index], trace->block_sizes[index]);
+            reads -= 1;
         }
     }
 }
@@ -1330,6 +2202,603 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printcounters - prints the hardware event counts of each trace,
+ *     divided by the number of ops so traces can be compared
+ */
+static void printcounters(int n, stats_t *stats)
+{
+    int i, e;
+
+    for (e = 0; e < PERFCTR_NEVENTS; e++)
+        printf("%14s", perfctr_names[e]);
+    printf("  %s\n", "trace");
+
+    for (i = 0; i < n; i++) {
+        for (e = 0; e < PERFCTR_NEVENTS; e++) {
+            if (stats[i].valid && stats[i].hw[e] >= 0)
+                printf("%14.2f", stats[i].hw[e] / stats[i].ops);
+            else
+                printf("%14s", "-");
+        }
+        printf("  %s\n", stats[i].filename);
+    }
+}
+
+/*
+ * printtiming - prints the fastest sample and the median with its
+ *     confidence interval for each trace, as measured by -e bench
+ */
+static void printtiming(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%10s%10s%10s%10s%5s%5s  %s\n", "min", "median", "ci_lo",
+           "ci_hi", "n", "out", "trace");
+    for (i = 0; i < n; i++) {
+        if (stats[i].valid)
+            printf("%10.6f%10.6f%10.6f%10.6f%5d%5d  %s\n",
+                   stats[i].secs_min, stats[i].secs_median,
+                   stats[i].secs_ci_lo, stats[i].secs_ci_hi,
+                   stats[i].samples, stats[i].rejected, stats[i].filename);
+        else
+            printf("%10s%10s%10s%10s%5s%5s  %s\n", "-", "-", "-", "-",
+                   "-", "-", stats[i].filename);
+    }
+}
+
+/*
+ * printcache - prints the throughput of each trace with cold and with
+ *     warm caches (-m both)
+ */
+static void printcache(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%10s%10s%8s  %s\n", "cold Kops", "warm Kops", "ratio", "trace");
+    for (i = 0; i < n; i++) {
+        if (stats[i].valid)
+            printf("%10.0f%10.0f%8.2f  %s\n",
+                   (stats[i].ops/1e3)/stats[i].secs,
+                   (stats[i].ops/1e3)/stats[i].secs_warm,
+                   stats[i].secs/stats[i].secs_warm, stats[i].filename);
+        else
+            printf("%10s%10s%8s  %s\n", "-", "-", "-", stats[i].filename);
+    }
+}
+
+/*
+ * printreallocs - prints how many of the reallocs in each trace
+ *     returned the same block, in the util run and in the speed run
+ */
+static void printreallocs(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%10s%10s%10s  %s\n", "reallocs", "util", "speed", "trace");
+    for (i = 0; i < n; i++) {
+        if (stats[i].reallocs == 0)
+            continue;
+        if (stats[i].valid)
+            printf("%10d%10d%10d  %s\n", stats[i].reallocs,
+                   stats[i].inplace_util, stats[i].inplace_speed,
+                   stats[i].filename);
+        else
+            printf("%10d%10s%10s  %s\n", stats[i].reallocs, "-", "-",
+                   stats[i].filename);
+    }
+}
+
+/*
+ * printthreads - prints the aggregate throughput of the threaded
+ *     replays of each trace, over the wall-clock time of the replay,
+ *     and the throughput of each thread over its own time (-T)
+ */
+static void printthreads(int n, stats_t *stats)
+{
+    int i, k, t, width = 5;
+
+    /* Pad the per-thread column to the widest sweep of any trace */
+    for (i = 0; i < n; i++)
+        for (k = 0; k < stats[i].nsweep; k++)
+            if (stats[i].sweep_threads[k] > width)
+                width = stats[i].sweep_threads[k];
+    width *= 8;
+
+    printf("%8s%10s  %-*s%s\n", "threads", "Kops", width,
+           "per-thread Kops", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid) {
+            printf("%8s%10s  %-*s%s\n", "-", "-", width, "-",
+                   stats[i].filename);
+            continue;
+        }
+        for (k = 0; k < stats[i].nsweep; k++) {
+            printf("%8d%10.0f  ", stats[i].sweep_threads[k],
+                   (stats[i].ops/1e3)/stats[i].sweep_secs[k]);
+            for (t = 0; t < stats[i].sweep_threads[k]; t++)
+                printf("%-8.0f", stats[i].sweep_kops[k][t]);
+            printf("%*s", width - 8*t, "");
+            printf("%s\n", k == 0 ? stats[i].filename : "");
+        }
+    }
+}
+
+/*
+ * printcombined - prints the util and throughput of several allocators
+ *     on the same traces next to each other. stats holds n results for
+ *     each allocator in turn.
+ */
+static void printcombined(int nbackends, const mm_backend_t **backends,
+                          int n, stats_t *stats)
+{
+    int i, b;
+    const char *name;
+    stats_t *s;
+    double avg_util, avg_throughput, p1, p2;
+
+    printf("%-20s", "");
+    for (b = 0; b < nbackends; b++)
+        printf("%15s", backends[b]->name);
+    printf("\n%-20s", "trace");
+    for (b = 0; b < nbackends; b++)
+        printf("%7s%8s", "util", "Kops");
+    printf("\n");
+
+    for (i = 0; i < n; i++) {
+        name = strrchr(stats[i].filename, '/');
+        printf("%-20s", name ? name + 1 : stats[i].filename);
+        for (b = 0; b < nbackends; b++) {
+            s = &stats[b * n + i];
+            if (s->valid)
+                printf("%6.0f%%%8.0f", s->util * 100.0,
+                       (s->ops/1e3)/s->secs);
+            else
+                printf("%7s%8s", "-", "-");
+        }
+        printf("\n");
+    }
+
+    printf("%-20s", "average");
+    for (b = 0; b < nbackends; b++) {
+        perfindex(n, stats + b * n, &avg_util, &avg_throughput, &p1, &p2);
+        printf("%6.0f%%%8.0f", avg_util * 100.0, avg_throughput / 1e3);
+    }
+    printf("\n");
+}
+
+/*
+ * perfindex - computes the performance index of one allocator from
+ *     its per-trace stats, along with the average utilization and
+ *     throughput that go into it
+ *
+ *     trace weight:
+ *     weight 1 => count both util and perf
+ *            2 => count only util
+ *            3 => count only perf
+ */
+static double perfindex(int n, stats_t *stats, double *avg_util,
+                        double *avg_throughput, double *p1, double *p2)
+{
+    int i;
+    double secs = 0, ops = 0, util = 0;
+    double util_weight = 0, perf_weight = 0;
+    double index;
+
+    for (i=0; i < n; i++) {
+        if(stats[i].weight == WALL || stats[i].weight == WPERF)
+            {
+                secs += stats[i].secs;
+                ops += stats[i].ops;
+                perf_weight++;
+            }
+        if(stats[i].weight == WALL || stats[i].weight == WUTIL)
+            {
+                util += stats[i].util;
+                util_weight++;
+            }
+    }
+
+    if(util_weight == 0)
+        *avg_util = 0;
+    else
+        *avg_util = util/util_weight;
+
+    if(perf_weight == 0) {
+        *avg_throughput = 0;
+    }
+    else {
+        *avg_throughput = (secs == 0) ? 0 : ops/secs;
+    }
+
+#ifdef ALT_GRADING
+    if (*avg_throughput < MIN_SPEED) {
+        *p2 = 0.0;
+    } else if (*avg_throughput > MAX_SPEED) {
+        *p2 = 1.0;
+    } else {
+        *p2 = (*avg_throughput - MIN_SPEED) / (MAX_SPEED - MIN_SPEED);
+    }
+
+    if (*avg_util < MIN_SPACE) {
+        *p1 = 0.0;
+    } else if (*avg_util > MAX_SPACE) {
+        *p1 = 1.0;
+    } else {
+        *p1 = (*avg_util - MIN_SPACE) / (MAX_SPACE - MIN_SPACE);
+    }
+
+    index = *p1 < *p2 ? *p1 * 100.0 : *p2 * 100.0; 
+    if(index < 0.0) index = 0.0;
+    if(index > 100.0) index = 100.0;
+#else
+    if (*avg_util < MIN_SPACE) {
+        *p1 = 0.0;
+    } else if (*avg_util > MAX_SPACE) {
+        *p1 = UTIL_WEIGHT;
+    } else {
+        *p1 = (*avg_util - MIN_SPACE) / (MAX_SPACE - MIN_SPACE) * UTIL_WEIGHT;
+    }
+
+    if (*avg_throughput < MIN_SPEED) {
+        *p2 = 0.0;
+    } else if (*avg_throughput > MAX_SPEED) {
+        *p2 = 1.0 - UTIL_WEIGHT;
+    } else {
+        *p2 = (*avg_throughput - MIN_SPEED) / (MAX_SPEED - MIN_SPEED) * (1.0 - UTIL_WEIGHT);
+    }
+
+    index = (*p1 + *p2)*100.0;
+#endif
+
+    return index;
+}
+
+/*
+ * select_backends - fill in backends from a comma-separated list of
+ *     allocator names and return how many there were
+ */
+static int select_backends(char *list, const mm_backend_t **backends)
+{
+    char *names, *name;
+    const mm_backend_t *b;
+    int n = 0;
+
+    if ((names = strdup(list)) == NULL)
+        unix_error("strdup failed in select_backends");
+
+    for (name = strtok(names, ","); name; name = strtok(NULL, ",")) {
+        if ((b = find_backend(name)) == NULL) {
+            printf("Unknown allocator \"%s\". Choose from:", name);
+            for (b = mm_backends; b->name != NULL; b++)
+                printf(" %s", b->name);
+            app_error("\n");
+        }
+        if (n == MAXBACKENDS - 1)
+            app_error("Too many allocators (max %d)\n", MAXBACKENDS - 1);
+        backends[n++] = b;
+    }
+
+    free(names);
+    return n;
+}
+
+/*
+ * save_spread - record the spread of the samples behind the last fsecs(),
+ *     and the hardware event counts if any
+ */
+static void save_spread(stats_t *stats)
+{
+    fsecs_spread_t spread;
+
+    get_fsecs_counters(stats->hw);
+    get_fsecs_spread(&spread);
+    stats->samples = spread.samples;
+    stats->rejected = spread.rejected;
+    stats->secs_mean = spread.mean;
+    stats->secs_min = spread.min;
+    stats->secs_max = spread.max;
+    stats->secs_sd = spread.stddev;
+    stats->secs_median = spread.median;
+    stats->secs_ci_lo = spread.ci_lo;
+    stats->secs_ci_hi = spread.ci_hi;
+}
+
+/*
+ * json_write_string - write s to fp as a quoted JSON string, escaping
+ *     quotes, backslashes and control characters
+ */
+static void json_write_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(fp, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(fp, "\\u%04x", (unsigned char)*s);
+        else
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * write_results - write every field of the per-trace stats to file,
+ *     as JSON if the name ends in ".json" and as CSV otherwise. The
+ *     JSON keeps each trace on one line so read_results can scan it.
+ */
+static void write_results(const char *file, int n, stats_t *stats)
+{
+    FILE *fp;
+    const char *dot = strrchr(file, '.');
+    int json = (dot != NULL && strcmp(dot, ".json") == 0);
+    int i, e;
+
+    if ((fp = fopen(file, "w")) == NULL)
+        unix_error("Could not open %s in write_results", file);
+
+    if (json)
+        fprintf(fp, "{\n  \"traces\": [\n");
+    else
+    {
+        fprintf(fp, "allocator,trace,weight,valid,ops,secs,secs_mean,"
+                "secs_max,secs_sd,samples,util,secs_min,secs_median,"
+                "secs_ci_lo,secs_ci_hi,rejected,secs_warm");
+        for (e = 0; e < PERFCTR_NEVENTS; e++)
+            fprintf(fp, ",%s", perfctr_names[e]);
+        fprintf(fp, "\n");
+    }
+
+    for (i = 0; i < n; i++) {
+        if (json) {
+            fprintf(fp, "    {\"allocator\": ");
+            json_write_string(fp, stats[i].allocator);
+            fprintf(fp, ", \"trace\": ");
+            json_write_string(fp, stats[i].filename);
+            fprintf(fp, ", \"weight\": %d, "
+                    "\"valid\": %d, \"ops\": %.0f, \"secs\": %.9g, "
+                    "\"secs_mean\": %.9g, \"secs_max\": %.9g, "
+                    "\"secs_sd\": %.9g, \"samples\": %d, "
+                    "\"util\": %.6f, \"secs_min\": %.9g, "
+                    "\"secs_median\": %.9g, \"secs_ci_lo\": %.9g, "
+                    "\"secs_ci_hi\": %.9g, \"rejected\": %d, "
+                    "\"secs_warm\": %.9g",
+                    stats[i].weight,
+                    stats[i].valid,
+                    stats[i].ops, stats[i].secs, stats[i].secs_mean,
+                    stats[i].secs_max, stats[i].secs_sd, stats[i].samples,
+                    stats[i].util, stats[i].secs_min, stats[i].secs_median,
+                    stats[i].secs_ci_lo, stats[i].secs_ci_hi,
+                    stats[i].rejected, stats[i].secs_warm);
+            for (e = 0; e < PERFCTR_NEVENTS; e++)
+                fprintf(fp, ", \"%s\": %.0f", perfctr_names[e],
+                        stats[i].hw[e]);
+            fprintf(fp, "}%s\n", i < n-1 ? "," : "");
+        }
+        else {
+            fprintf(fp, "%s,%s,%d,%d,%.0f,%.9g,%.9g,%.9g,%.9g,%d,%.6f,"
+                    "%.9g,%.9g,%.9g,%.9g,%d,%.9g",
+                    stats[i].allocator, stats[i].filename, stats[i].weight,
+                    stats[i].valid,
+                    stats[i].ops, stats[i].secs, stats[i].secs_mean,
+                    stats[i].secs_max, stats[i].secs_sd, stats[i].samples,
+                    stats[i].util, stats[i].secs_min, stats[i].secs_median,
+                    stats[i].secs_ci_lo, stats[i].secs_ci_hi,
+                    stats[i].rejected, stats[i].secs_warm);
+            for (e = 0; e < PERFCTR_NEVENTS; e++)
+                fprintf(fp, ",%.0f", stats[i].hw[e]);
+            fprintf(fp, "\n");
+        }
+    }
+
+    if (json)
+        fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+}
+
+/*
+ * json_string - copy the value of "key": "<string>" in line to val,
+ *     undoing the escapes json_write_string adds; return 0 if missing
+ */
+static int json_string(const char *line, const char *key, char *val,
+                       size_t maxlen)
+{
+    char pat[MAXLINE];
+    const char *p;
+    size_t n = 0;
+    unsigned c;
+
+    sprintf(pat, "\"%s\": \"", key);
+    if ((p = strstr(line, pat)) == NULL)
+        return 0;
+    for (p += strlen(pat); *p != '"'; p++) {
+        if (*p == '\0' || n + 1 >= maxlen)
+            return 0;
+        if (*p == '\\') {
+            p++;
+            if (*p == 'u') {
+                if (sscanf(p + 1, "%4x", &c) != 1)
+                    return 0;
+                val[n++] = (char)c;
+                p += 4;
+                continue;
+            }
+            if (*p == '\0')
+                return 0;
+        }
+        val[n++] = *p;
+    }
+    val[n] = '\0';
+    return 1;
+}
+
+/*
+ * json_number - find "key": <number> in line; return 0 if missing
+ */
+static int json_number(const char *line, const char *key, double *val)
+{
+    char pat[MAXLINE];
+    const char *p;
+
+    sprintf(pat, "\"%s\":", key);
+    if ((p = strstr(line, pat)) == NULL)
+        return 0;
+    return sscanf(p + strlen(pat), "%lf", val) == 1;
+}
+
+/*
+ * read_results - load a results file written by write_results, in
+ *     either format. Returns an array of *n stats.
+ */
+static stats_t *read_results(const char *file, int *n)
+{
+    FILE *fp;
+    char line[MAXLINE];
+    stats_t *stats = NULL;
+    stats_t *s;
+    double val;
+    int max = 0;
+
+    if ((fp = fopen(file, "r")) == NULL)
+        unix_error("Could not open %s in read_results", file);
+
+    *n = 0;
+    while (fgets(line, MAXLINE, fp) != NULL) {
+        if (*n == max) {
+            max = max ? 2*max : 32;
+            if ((stats = realloc(stats, max * sizeof(stats_t))) == NULL)
+                unix_error("realloc failed in read_results");
+        }
+        s = &stats[*n];
+        memset(s, 0, sizeof(*s));
+
+        if (strstr(line, "\"trace\":") != NULL) {
+            /* One JSON trace object */
+            if (!json_string(line, "allocator", s->allocator, MAXNAME) ||
+                !json_string(line, "trace", s->filename, MAXLINE))
+                app_error("%s: bad trace entry: %s", file, line);
+            if (json_number(line, "weight", &val)) s->weight = val;
+            if (json_number(line, "valid", &val)) s->valid = val;
+            if (json_number(line, "samples", &val)) s->samples = val;
+            json_number(line, "ops", &s->ops);
+            json_number(line, "secs", &s->secs);
+            json_number(line, "secs_mean", &s->secs_mean);
+            json_number(line, "secs_max", &s->secs_max);
+            json_number(line, "secs_sd", &s->secs_sd);
+            json_number(line, "util", &s->util);
+        }
+        else if (strchr(line, ',') != NULL &&
+                 strncmp(line, "allocator,", 10) != 0) {
+            /* One CSV row */
+            if (sscanf(line, "%31[^,],%1023[^,],%d,%d,%lf,%lf,%lf,%lf,%lf,"
+                       "%d,%lf", s->allocator, s->filename, &s->weight, &s->valid, &s->ops,
+                       &s->secs, &s->secs_mean, &s->secs_max, &s->secs_sd,
+                       &s->samples, &s->util) != 11)
+                app_error("%s: bad results line: %s", file, line);
+        }
+        else
+            continue;
+        (*n)++;
+    }
+    fclose(fp);
+    return stats;
+}
+
+/*
+ * same_trace - do two results refer to the same allocator and trace
+ *     file? Only the base names of the traces are compared, so the
+ *     trace directory may differ.
+ */
+static int same_trace(const stats_t *x, const stats_t *y)
+{
+    const char *a = x->filename, *b = y->filename;
+    const char *p;
+
+    if (strcmp(x->allocator, y->allocator) != 0)
+        return 0;
+
+    if ((p = strrchr(a, '/')) != NULL)
+        a = p + 1;
+    if ((p = strrchr(b, '/')) != NULL)
+        b = p + 1;
+    return strcmp(a, b) == 0;
+}
+
+/*
+ * compare_results - compare each trace against the baseline file and
+ *     report the ones that got slower or less space efficient. A
+ *     slowdown has to be significant at the given confidence (Welch's
+ *     t test on the mean sample time) and larger than REGRESS_MIN_DELTA,
+ *     so noise between runs isn't reported as a regression. Returns
+ *     the number of regressed traces.
+ */
+static int compare_results(int n, stats_t *stats, const char *basefile,
+                           double confidence)
+{
+    stats_t *base, *b;
+    int nbase, i, j;
+    int regressions = 0;
+    double t, df, delta;
+    int slower, lessutil;
+
+    base = read_results(basefile, &nbase);
+
+    printf("\nComparison against %s (%.0f%% confidence):\n",
+           basefile, confidence * 100.0);
+    printf("  %9s%9s%8s%7s%7s  %s\n",
+           "base Kops", "Kops", "change", "b.util", "util", "allocator/trace");
+
+    for (i = 0; i < n; i++) {
+        b = NULL;
+        for (j = 0; j < nbase; j++) {
+            if (same_trace(&stats[i], &base[j])) {
+                b = &base[j];
+                break;
+            }
+        }
+        if (b == NULL || !b->valid)
+            continue;
+
+        if (!stats[i].valid) {
+            printf("%2s%9s%9s%8s%7s%7s  %s/%s (no longer valid)\n", "!",
+                   "-", "-", "-", "-", "-", stats[i].allocator,
+                   stats[i].filename);
+            regressions++;
+            continue;
+        }
+
+        /* throughput: only flag significant slowdowns */
+        slower = 0;
+        if (stats[i].weight != WUTIL && b->secs_mean > 0) {
+            delta = (stats[i].secs_mean - b->secs_mean) / b->secs_mean;
+            t = tstat_welch(stats[i].secs_mean, stats[i].secs_sd,
+                            stats[i].samples, b->secs_mean, b->secs_sd,
+                            b->samples, &df);
+            if (delta > REGRESS_MIN_DELTA)
+                slower = (df > 0) ? t > tstat_quantile(confidence, df) : 1;
+        }
+
+        /* utilization is deterministic, so any real drop counts */
+        lessutil = (stats[i].weight != WPERF &&
+                    b->util - stats[i].util > REGRESS_MIN_DELTA * b->util);
+
+        printf("%2s%9.0f%9.0f%+7.1f%%%6.0f%%%6.0f%%  %s/%s\n",
+               (slower || lessutil) ? "!" : "",
+               b->secs_mean > 0 ? (b->ops/1e3)/b->secs_mean : 0,
+               stats[i].secs_mean > 0 ? (stats[i].ops/1e3)/stats[i].secs_mean : 0,
+               b->secs_mean > 0 ?
+               (b->secs_mean/stats[i].secs_mean - 1.0) * 100.0 : 0,
+               b->util * 100.0, stats[i].util * 100.0, stats[i].allocator,
+               stats[i].filename);
+
+        if (slower || lessutil)
+            regressions++;
+    }
+
+    free(base);
+    return regressions;
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1375,7 +2844,10 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlVdDHgb] [-a <list>] [-f <file>] [-F <file>] [-N <n>]\n");
+    fprintf(stderr, "               [-P <frac>] [-e <engine>] [-w <n>] [-r <n>[:<max>]] [-p <cpu>]\n");
+    fprintf(stderr, "               [-m <mode>] [-T <n>] [-L <n>]\n");
+    fprintf(stderr, "               [-o <file>] [-B <file>] [-z <conf>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
@@ -1383,8 +2855,39 @@ static void usage(void)
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-H         Count hardware events (cache, TLB, branch misses).\n");
+    fprintf(stderr, "\t-a <list>  Run the comma-separated allocators in <list>\n");
+    fprintf(stderr, "\t           side by side (mm, mt, mtlock, heaps, arena, addr,\n");
+    fprintf(stderr, "\t           high, index, bitmap, naive, libc;\n");
+    fprintf(stderr, "\t           default mm).\n");
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F <file>  Write fragmentation samples as CSV to <file>.\n");
+    fprintf(stderr, "\t-N <n>     Sample fragmentation every <n> ops (default 1000).\n");
+    fprintf(stderr, "\t-P <frac>  Time with payload touching: write every new block and\n");
+    fprintf(stderr, "\t           read <frac> of the live blocks after each op.\n");
+    fprintf(stderr, "\t-e <name>  Timing engine: fcyc (K-best minimum, default) or\n");
+    fprintf(stderr, "\t           bench (median with confidence interval).\n");
+    fprintf(stderr, "\t-w <n>     bench: untimed warm-up runs per trace (default 1).\n");
+    fprintf(stderr, "\t-r <n>     bench: take <n> samples, or from <n> up to <max>\n");
+    fprintf(stderr, "\t           until the median is within 1%% (default 5:50).\n");
+    fprintf(stderr, "\t-T <n>     Also replay each trace on 1, 2, 4 ... up to <n> threads.\n");
+    fprintf(stderr, "\t-m <mode>  Start each timing sample with cold caches (default),\n");
+    fprintf(stderr, "\t           warm caches, or time both.\n");
+    fprintf(stderr, "\t-p <cpu>   Pin the driver to CPU <cpu> while timing.\n");
+    fprintf(stderr, "\t-u <ms>    Purge free pages in the background over <ms> (mt);\n");
+    fprintf(stderr, "\t           <ms>:lazy purges with MADV_FREE.\n");
+    fprintf(stderr, "\t-L <n>     Tell the allocator which blocks live for more than\n");
+    fprintf(stderr, "\t           <n> requests (mm_malloc_hint), as an oracle would.\n");
+    fprintf(stderr, "\t-g         Replay region and pool requests with malloc and\n");
+    fprintf(stderr, "\t           free, as for allocators without them.\n");
+    fprintf(stderr, "\t-b         Free with mm_free_sized (mt), and make runs of mallocs\n");
+    fprintf(stderr, "\t           of one size and runs of frees with mm_malloc_batch\n");
+    fprintf(stderr, "\t           and mm_free_batch.\n");
+    fprintf(stderr, "\t-o <file>  Write per-trace results to <file> (.json or .csv).\n");
+    fprintf(stderr, "\t-B <file>  Flag regressions against the results in <file>.\n");
+    fprintf(stderr, "\t-z <conf>  Confidence level for -B (default %.2f).\n",
+            REGRESS_CONFIDENCE);
 }
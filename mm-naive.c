@@ -10,6 +10,7 @@
  * it never frees anything.
  */
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,6 +36,11 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define malloc_usable_size mm_usable_size
+#define free_sized mm_free_sized
+#define malloc_batch mm_malloc_batch
+#define free_batch mm_free_batch
 #endif /* def DRIVER */
 
 /* single word (4) or double word (8) alignment */
@@ -75,6 +81,31 @@ void *malloc(size_t size)
   }
 }
 
+/*
+ * memalign - Allocate a block whose payload starts at a multiple of
+ *      alignment, by first moving the brk pointer up to one. Takes
+ *      the same alignments as mm.c's.
+ */
+void *memalign(size_t alignment, size_t size)
+{
+  char *brk = (char *)mem_heap_hi() + 1;
+  char *p;
+
+  if (alignment <= ALIGNMENT)
+    return malloc(size);
+  if ((alignment & (alignment - 1)) != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (size == 0)
+    return NULL;
+  p = (char *)(((size_t)brk + SIZE_T_SIZE + alignment-1) & ~(alignment-1));
+  if ((long)mem_sbrk(p - brk + ALIGN(size)) < 0)
+    return NULL;
+  *SIZE_PTR(p) = size;
+  return p;
+}
+
 /*
  * free - We don't know how to free a block.  So we ignore this call.
  *      Computers have big memories; surely it won't be a problem.
@@ -124,6 +155,45 @@ void *realloc(void *oldptr, size_t size)
   return newptr;
 }
 
+/*
+ * free_sized - Nothing to free, whatever the size.
+ */
+void free_sized(void *ptr, size_t size)
+{
+  ptr = ptr; size = size;
+}
+
+/*
+ * malloc_batch - One malloc after another.
+ */
+size_t malloc_batch(size_t size, size_t n, void **out)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    if ((out[i] = malloc(size)) == NULL)
+      break;
+  return i;
+}
+
+/*
+ * free_batch - Nothing to free either.
+ */
+void free_batch(void **ptrs, size_t n)
+{
+  ptrs = ptrs; n = n;
+}
+
+/*
+ * malloc_usable_size - Just the size that was asked for.
+ */
+size_t malloc_usable_size(void *ptr)
+{
+  if (ptr == NULL)
+    return 0;
+  return *SIZE_PTR(ptr);
+}
+
 /*
  * calloc - Allocate the block and set it to zero.
  */
@@ -146,3 +216,16 @@ void mm_checkheap(int verbose){
 	/*Get gcc to be quiet. */
 	verbose = verbose;
 }
+
+/*
+ * mm_heapstats - Nothing is ever freed, so the whole heap is in
+ *      allocated blocks.
+ */
+void mm_heapstats(mm_heapstats_t *stats)
+{
+  stats->free_bytes = 0;
+  stats->largest_free = 0;
+  stats->alloc_bytes = mem_heapsize();
+  stats->dirty_bytes = 0;
+  stats->purged_bytes = 0;
+}
@@ -9,24 +9,78 @@
  * payload of more than 2^(MAX_CLASS+1). Each class have payload in range of 2^(CLASS INDEX+1) - 2^(CLASS_INDEX+2)
  * eg. if we have 4 classes, payload range is (class1,class2,class3,class4) = ( 1-8 , 9-16 , 17-32 , >32 )
  * Plolog contain |Header| ptr to class 1| ptr to class 2|...|ptr to class MAX_CLASS|Footer
+ *
+ * Built with -DMM_THREADS, the heap is shared under one lock and each thread
+ * keeps a small cache of free blocks per size (see tcache_get), so that only
+ * cache misses take the lock. Threads trade batches of those blocks through
+ * lock-free stacks, one per size (see depot_pop); -DMM_CLASS_LOCKS guards
+ * each stack with a mutex instead, for comparison. The class lists stay
+ * under the lock.
+ *
+ * Built with -DMM_THREAD_HEAPS, each thread instead allocates from a heap
+ * of its own (see heap_attach), made of chunks of whole pages. A block
+ * freed by a thread that doesn't own it is pushed onto its owner's stack
+ * of remote frees without taking any lock, and the owner frees it when it
+ * next fails to find a fit (see remote_drain).
+ *
+ * Adding -DMM_CPU_ARENAS makes those heaps arenas, one per CPU rather
+ * than one per thread: each request uses the arena of the CPU it runs on
+ * (see heap_get), under the arena's lock.
+ *
+ * Built with -DMM_ADDR_ORDER, the list of the largest class is kept in
+ * address order rather than LIFO, so that first fit in it gives
+ * address-ordered best fit. Inserts find their place through a skip list
+ * whose forward pointers live at the end of the free blocks (see
+ * insert_ordered).
+ *
+ * Built with -DMM_PLACE_HIGH, malloc carves blocks from the end of free
+ * blocks rather than the start, so that what is left keeps its header
+ * and, if its class is unchanged, its place on the list (see place_high).
+ *
+ * Built with -DMM_FIT_INDEX, the blocks of the largest class are also
+ * indexed by packed arrays of their sizes and offsets, which find_fit
+ * scans with SIMD compares instead of walking the list (see fit_search).
+ *
+ * Built with -DMM_BITMAP, bitmaps beside the heap say where blocks start
+ * and which are allocated, so that coalesce, check_heap and mm_heapstats
+ * work from bits rather than the tags of neighbouring blocks.
  */
+#ifdef MM_CPU_ARENAS
+#define _GNU_SOURCE
+#endif
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdint.h>
+#if defined(MM_THREADS) || defined(MM_THREAD_HEAPS)
+#include <pthread.h>
+#endif
+#ifdef MM_THREADS
+#include <time.h>
+#include <sys/mman.h>
+#endif
+#ifdef MM_CPU_ARENAS
+#include <sched.h>             /* sched_getcpu, with _GNU_SOURCE */
+#endif
+#if defined(MM_FIT_INDEX) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
 
 /* If you want debugging output, use the following macro.  When you hand
  * in, remove the #define DEBUG line. */
-#define DEBUG
+//#define DEBUG
 #ifdef DEBUG
 # define dbg_printf(...) printf(__VA_ARGS__)
+# define dbg_checkheap() check_heap(1)
 #else
 # define dbg_printf(...)
+# define dbg_checkheap()
 #endif
 
 
@@ -37,6 +91,13 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
+#define malloc_usable_size mm_usable_size
+#define free_sized mm_free_sized
+#define malloc_batch mm_malloc_batch
+#define free_batch mm_free_batch
 #endif /* def DRIVER */
 
 /* single word (4) or double word (8) alignment */
@@ -51,9 +112,18 @@
 #define DSIZE       8       /* Doubleword size (bytes) */
 #define CHUNKSIZE  (1<<12)  /* Extend heap by this amount (bytes) */
 #define MINIMUM     24      /* Minimum block size */
+#define BATCH_RUN  (16*CHUNKSIZE) /* Most bytes malloc_batch carves at once */
+#define FREE_CHUNK 64       /* Most pointers free_batch sorts at once */
+#define REGION_FIRST 16     /* A region's first chunk fits this many first requests, */
+#define REGION_MIN   1024   /* and at least this many bytes */
+#define REGION_CHUNK CHUNKSIZE /* Largest default chunk; each doubles the last */
+#define SLAB_OBJS  8        /* Fewest objects a pool's slab holds */
+#define GROW_AFTER 2        /* Reallocs that grow a block before it gets slack */
+#define GROW_MAX   3        /* Most growth the tags can count */
 #define MAX_CLASS   4       /* Maximum number of class */
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc)) 
@@ -66,6 +136,12 @@
 #define GET_SIZE(p)  (GET(p) & ~0x7)                  
 #define GET_ALLOC(p) (GET(p) & 0x1)                    
 
+/* Allocated blocks count how often realloc has grown them in the two
+   spare bits of their tags (see realloc) */
+#define GROWTH(p)        ((GET(p) >> 1) & 0x3)
+#define PUT_GROWTH(bp, g) (PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)), 1) | ((g) << 1)), \
+                           PUT(FTRP(bp), GET(HDRP(bp))))
+
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)                      
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE) 
@@ -82,18 +158,298 @@
 
 
 /* Global variables */
+#ifdef MM_THREAD_HEAPS
+/* The calling thread's heap */
+static __thread char *heap_listp = 0;  /* Pointer to first block */
+static __thread char *free_listp = 0;  /* Pointer to first free block */
+#else
 static char *heap_listp = 0;  /* Pointer to first block */
 static char *free_listp = 0;  /* Pointer to first free block */
-static int current_class = 0;
+#endif
+
+#ifdef MM_THREADS
+/* Everything above, and the heap itself, belongs to whoever holds heap_lock */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK()    pthread_mutex_lock(&heap_lock)
+#define UNLOCK()  pthread_mutex_unlock(&heap_lock)
+
+/* Per-thread cache of free blocks of MINIMUM, MINIMUM+DSIZE, ... bytes */
+#define TCACHE_BINS   16      /* Number of cached block sizes */
+#define TCACHE_MAX    16      /* Most blocks a bin holds */
+#define TCACHE_BATCH  8       /* Most blocks moved per refill or flush */
+#define TCACHE_BIN(size)  (((size) - MINIMUM) / DSIZE)
+
+/* Cached blocks stay marked allocated, so that nothing coalesces them,
+   and are linked through the first word of their payload */
+typedef struct {
+    unsigned epoch;             /* mm_init generation the blocks belong to */
+    int count[TCACHE_BINS];
+    char *head[TCACHE_BINS];
+} tcache_t;
+
+static __thread tcache_t tcache;
+static unsigned heap_epoch = 1; /* bumped by mm_init, which drops every cache */
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Blocks of each cached size that threads have flushed, for any thread
+ * to refill from without taking heap_lock. Without MM_CLASS_LOCKS the
+ * head packs the block's 32-bit offset from the heap base (as the class
+ * heads in the prologue do) with a tag that every update bumps, so a
+ * compare-and-swap fails if the head was popped and pushed back between
+ * the load and the swap (ABA). Depot blocks stay marked allocated, so
+ * they are freed back to the heap (see depot_drain) before it grows.
+ *
+ * The class lists in the prologue are not lock-free, and can't be made
+ * so with a compare-and-swap on their heads: they are doubly linked,
+ * and coalescing and place unlink blocks from the middle of a list.
+ * A depot block is marked allocated, so nothing else unlinks it, and
+ * it only ever leaves by the head.
+ */
+#define DEPOT_BYTES   (8*CHUNKSIZE) /* Beyond this, flushes go to the heap */
+#define HEAP_BASE     0x800000000UL
+#define DEPOT_PTR(head)       ((char *)(uintptr_t)((uint32_t)(head) + HEAP_BASE))
+#define DEPOT_HEAD(bp, tag)   ((uint64_t)(tag) << 32 | \
+                               (bp ? (uint32_t)((uintptr_t)(bp) - HEAP_BASE) : 0))
+
+typedef struct {
+#ifdef MM_CLASS_LOCKS
+    pthread_mutex_t lock;
+    char *head;
+#else
+    uint64_t head;              /* tag << 32 | offset of the first block */
+#endif
+} __attribute__((aligned(64))) depot_t;
+
+static depot_t depot[TCACHE_BINS];
+static size_t depot_bytes;      /* about how many bytes all depots hold */
+
+/*
+ * A free block of at least PURGE_MIN bytes records, after its list
+ * links, when it was freed and how many of its pages (counting back
+ * from its end) the purge thread has given back to the OS. Coalescing
+ * or splitting it makes a new block, freed now; the new block keeps
+ * the purged pages only if it ends where the old one did (see
+ * keep_purged), so pages purged in the middle of a merged block are
+ * counted as resident until a pass purges them again.
+ */
+#define PURGE_MIN     (4*CHUNKSIZE)
+#define PURGE_STEPS   16      /* Purge passes per decay time */
+#define FREED_AT(bp)  (*(uint64_t *)((char *)(bp) + 2*DSIZE))
+#define PURGED(bp)    (*(size_t *)((char *)(bp) + 3*DSIZE))
+
+static pthread_t purge_thread;
+static pthread_mutex_t purge_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t purge_wake = PTHREAD_COND_INITIALIZER;
+/* Both are written under purge_lock; the purge thread reads them
+   there, and stamp_freed reads purge_decay atomically */
+static int purge_decay = 0;   /* ms; 0 when there is no purge thread */
+static int purge_advice = MADV_DONTNEED;
+#elif defined(MM_THREAD_HEAPS)
+/*
+ * Every chunk starts with a word holding its length, then the heap's
+ * prologue (first chunk) or an allocated DSIZE fence block, and ends
+ * with an epilogue, so blocks never coalesce across chunks of different
+ * heaps. page_owner says which heap each page belongs to.
+ */
+#define MAX_HEAPS   64
+#define MAX_PAGES   (1 << 16)   /* Pages page_owner can map (256 MB) */
+#define PAGE_SHIFT  12          /* log2(CHUNKSIZE) */
+#define PAGE_INDEX(p)  (((char *)(p) - (char *)mem_heap_lo()) >> PAGE_SHIFT)
+#define HEAP_OF(bp)    (&heaps[page_owner[PAGE_INDEX(bp)] - 1])
+
+typedef struct {
+    pthread_mutex_t lock; /* taken by the heap's users; remote frees never wait */
+    char *listp;          /* the heap's prologue (its heap_listp) */
+    char *chunk;          /* chunk extend_heap last grew */
+    char *end;            /* break just past that chunk */
+    char *remote;         /* blocks freed by other threads, linked
+                             through their first payload word */
+    int users;            /* threads allocating from the heap */
+} heap_t;
+
+static heap_t heaps[MAX_HEAPS];
+static unsigned char page_owner[MAX_PAGES]; /* heap index + 1, or 0 */
+
+/* heaps_lock guards heaps[] (but not the heaps), page_owner and mem_sbrk */
+static pthread_mutex_t heaps_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK()    pthread_mutex_lock(&heaps_lock)
+#define UNLOCK()  pthread_mutex_unlock(&heaps_lock)
+
+static __thread heap_t *my_heap; /* heap the thread is working on */
+static unsigned heap_epoch = 1; /* bumped by mm_init, which drops every heap */
+#ifdef MM_CPU_ARENAS
+static int narenas = 1;         /* arenas in use, at most MAX_HEAPS */
+#else
+static __thread unsigned my_epoch;
+static pthread_key_t heap_key;
+static pthread_once_t heap_once = PTHREAD_ONCE_INIT;
+#endif
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
 
 //#define CLASSP(class)  (char *)(heap_listp + WSIZE*(class-1)) //pointer to class in prolog
 //#define HEAD_CLASSP(class)  (*(char **)(heap_listp + WSIZE*(class-1)))
 #define SET_HEAD_CLASSP(bp,class) (PUT(heap_listp + WSIZE*(class-1), (size_t)bp))
 
+/* Which end of a free block malloc carves blocks from */
+#ifdef MM_PLACE_HIGH
+#define PLACE(bp, asize)  place_high(bp, asize)
+#else
+#define PLACE(bp, asize)  (place(bp, asize), (char *)(bp))
+#endif
+
+#ifdef MM_ADDR_ORDER
+#ifdef MM_THREAD_HEAPS
+#error "MM_ADDR_ORDER keeps one set of skip list heads, so needs a single heap"
+#endif
+/*
+ * Level 0 of the skip list is the list of class MAX_CLASS. A free block
+ * on levels 1..skip_level(bp) keeps its forward pointer for level k at
+ * FTRP(bp) - k*DSIZE, so only blocks with room for them get levels.
+ */
+#define SKIP_LEVELS   8
+#define SKIP_NEXT(bp, k)  (*(char **)(FTRP(bp) - (k)*DSIZE))
+
+static char *skip_head[SKIP_LEVELS+1];
+#endif
+
+#ifdef MM_FIT_INDEX
+#if defined(MM_THREAD_HEAPS) || defined(MM_ADDR_ORDER)
+#error "MM_FIT_INDEX keeps one index of a LIFO list, so needs a single heap"
+#endif
+/*
+ * The blocks on the list of class MAX_CLASS, the only class with more
+ * than two sizes in it, each have a slot in fit_size and fit_offset
+ * (their offset from the heap base), which they record in the word
+ * before their footer. Blocks freed while every slot is taken are on
+ * the list alone, with FIT_NONE, and find_fit walks the list for them.
+ */
+#define FIT_SLOTS     (1 << 14)
+#define FIT_NONE      0xffffffffu
+#define FIT_SLOT(bp)  (*(unsigned int *)(FTRP(bp) - WSIZE))
+#define FIT_PTR(i)    ((char *)mem_heap_lo() + fit_offset[i])
+
+static unsigned int fit_size[FIT_SLOTS] __attribute__((aligned(32)));
+static unsigned int fit_offset[FIT_SLOTS];
+static unsigned int fit_count = 0;     /* slots in use, from 0 */
+static unsigned int fit_overflow = 0;  /* blocks with no slot */
+static int (*fit_scan)(unsigned int asize);
+#endif
+
+#ifdef MM_BITMAP
+#ifdef MM_THREAD_HEAPS
+#error "MM_BITMAP maps a single heap, not chunks with fence blocks"
+#endif
+/*
+ * Bit g of map_start is set if a block's payload starts at granule g,
+ * the DSIZE bytes at mem_heap_lo() + g*DSIZE. A block's granules count
+ * from its payload on, and map_alloc has its first and last set if it
+ * is allocated and clear if not (bits in between mean nothing). So the
+ * block before bp is allocated if the bit before GRANULE(bp) is set.
+ * The epilogue counts as an allocated block of one granule.
+ */
+#define MAP_SPAN     (1UL << 27)   /* Heap bytes the maps cover (128 MB) */
+#define MAP_WORDS    (MAP_SPAN / DSIZE / 64)
+#define GRANULE(p)   ((size_t)((char *)(p) - (char *)mem_heap_lo()) / DSIZE)
+#define MAP_TEST(map, g)  ((map)[(g) / 64] >> ((g) % 64) & 1)
+
+static uint64_t map_start[MAP_WORDS];
+static uint64_t map_alloc[MAP_WORDS];
+static size_t map_used = 0;   /* words of the maps that may be nonzero */
+
+/*
+ * map_set - Set bits from up to (not including) to of map, or clear
+ *      them if set is 0
+ */
+static inline void map_set(uint64_t *map, size_t from, size_t to, int set)
+{
+    size_t w = from / 64, last = (to - 1) / 64;
+    uint64_t lo = ~0ULL << (from % 64), hi = ~0ULL >> (63 - (to - 1) % 64);
+    
+    if (set)
+        map_used = MAX(map_used, last + 1);
+    if (w == last)
+        lo &= hi;
+    map[w] = set ? map[w] | lo : map[w] & ~lo;
+    if (w == last)
+        return;
+    while (++w < last)
+        map[w] = set ? ~0ULL : 0;
+    map[last] = set ? map[last] | hi : map[last] & ~hi;
+}
+
+/*
+ * map_next - First set bit of map at or after bit g; there must be one
+ */
+static inline size_t map_next(const uint64_t *map, size_t g)
+{
+    size_t w = g / 64;
+    uint64_t bits = map[w] & (~0ULL << (g % 64));
+    
+    while (bits == 0)
+        bits = map[++w];
+    return w * 64 + __builtin_ctzll(bits);
+}
+
+/*
+ * map_ends - Set the first and last bits in map_alloc of the block of
+ *      size bytes at bp, or clear them if alloc is 0
+ */
+static inline void map_ends(void *bp, size_t size, int alloc)
+{
+    size_t g = GRANULE(bp), h = g + size/DSIZE - 1;
+    
+    if (alloc) {
+        map_alloc[g / 64] |= 1ULL << (g % 64);
+        map_alloc[h / 64] |= 1ULL << (h % 64);
+        map_used = MAX(map_used, h / 64 + 1);
+    }
+    else {
+        map_alloc[g / 64] &= ~(1ULL << (g % 64));
+        map_alloc[h / 64] &= ~(1ULL << (h % 64));
+    }
+}
+
+/* Block bp starts, or no longer does */
+#define MAP_MARK(bp)      map_set(map_start, GRANULE(bp), GRANULE(bp) + 1, 1)
+#define MAP_UNMARK(bp)    map_set(map_start, GRANULE(bp), GRANULE(bp) + 1, 0)
+/* The block of size bytes at bp is allocated, or free */
+#define MAP_USE(bp, size)    map_ends(bp, size, 1)
+#define MAP_UNUSE(bp, size)  map_ends(bp, size, 0)
+#else
+#define MAP_MARK(bp)
+#define MAP_UNMARK(bp)
+#define MAP_USE(bp, size)
+#define MAP_UNUSE(bp, size)
+#endif
+
+/* Round p to a page boundary (CHUNKSIZE is one page) */
+#define PAGE_UP(p)    ((char *)(((uintptr_t)(p) + CHUNKSIZE-1) & ~(uintptr_t)(CHUNKSIZE-1)))
+#define PAGE_DOWN(p)  ((char *)((uintptr_t)(p) & ~(uintptr_t)(CHUNKSIZE-1)))
+
+/* Walk the chunks of the heap; a chunk's first block is at chunk + DSIZE */
+#ifdef MM_THREAD_HEAPS
+#define FIRST_CHUNK()  (mem_heapsize() > 0 ? (char *)mem_heap_lo() : NULL)
+#define NEXT_CHUNK(c)  ((c) + GET(c) < (char *)mem_heap_hi() ? (c) + GET(c) : NULL)
+#else
+#define FIRST_CHUNK()  (heap_listp - DSIZE)
+#define NEXT_CHUNK(c)  NULL
+#endif
+
 
 /* Function prototypes for internal helper routines */
 static inline void *extend_heap(size_t words);
+static int init_heap(void);
+static void *alloc_block(size_t asize);
+static void *alloc_aligned(size_t asize, size_t alignment);
+static void *alloc_high(size_t asize);
+static void free_block(void *bp);
 static inline void place(void *bp, size_t asize);
+static inline void *place_high(void *bp, size_t asize);
 static inline void *find_fit(size_t asize);
 static inline void *coalesce(void *bp);
 static void print_block(void *bp);
@@ -103,6 +459,21 @@ static void unit_test();
 static inline void insert_free_block(void *bp);
 static inline void remove_free_block(void *bp);
 static inline int find_minimum_class(int asize);
+#ifdef MM_THREADS
+static void depot_reset(void);
+static int depot_drain(void);
+static uint64_t now_ms(void);
+#endif
+#ifdef MM_FIT_INDEX
+static int (*fit_scan_best(void))(unsigned int);
+static inline void *fit_search(size_t asize);
+static inline void fit_add(void *bp);
+static inline void fit_remove(void *bp);
+#endif
+#ifdef MM_THREAD_HEAPS
+static void set_page_owner(char *chunk, size_t size);
+static int reset_heaps(void);
+#endif
 //static inline void *link_head(int class);
 
 static inline void *get_head_classp(int class)
@@ -135,6 +506,60 @@ static inline void *get_head_classp(int class)
     
 }
 
+/*
+ * page_span - Number of whole pages in free block bp past its links
+ *      (and purge record) and before its footer; *hi is set to the end
+ *      of the last of them
+ */
+static inline size_t page_span(void *bp, char **hi)
+{
+    char *lo = PAGE_UP((char *)bp + 4*DSIZE);
+    
+#ifdef MM_ADDR_ORDER
+    *hi = PAGE_DOWN(FTRP(bp) - SKIP_LEVELS*DSIZE);
+#elif defined(MM_FIT_INDEX)
+    *hi = PAGE_DOWN(FTRP(bp) - WSIZE);
+#else
+    *hi = PAGE_DOWN(FTRP(bp));
+#endif
+    return (*hi > lo) ? (size_t)(*hi - lo) / CHUNKSIZE : 0;
+}
+
+#ifdef MM_THREADS
+/*
+ * stamp_freed - Record that free block bp was freed now, with none of
+ *      its pages purged yet
+ */
+static inline void stamp_freed(void *bp)
+{
+    if (GET_SIZE(HDRP(bp)) >= PURGE_MIN) {
+        FREED_AT(bp) = __atomic_load_n(&purge_decay, __ATOMIC_RELAXED) ?
+            now_ms() : 0;
+        PURGED(bp) = 0;
+    }
+}
+
+/* Pages of free block bp that have been purged, if it records them */
+#define PURGED_PAGES(bp) \
+    (GET_SIZE(HDRP(bp)) >= PURGE_MIN ? PURGED(bp) : 0)
+
+/*
+ * keep_purged - Free block bp, just put on a list, ends where a free
+ *      block with purged pages did; those pages are still purged
+ */
+static inline void keep_purged(void *bp, size_t purged)
+{
+    char *hi;
+    
+    if (purged > 0 && GET_SIZE(HDRP(bp)) >= PURGE_MIN)
+        PURGED(bp) = MIN(purged, page_span(bp, &hi));
+}
+#else
+#define stamp_freed(bp)
+#define PURGED_PAGES(bp)  0
+#define keep_purged(bp, purged)  ((void)(bp), (void)(purged))
+#endif
+
 
 /* this function is used for unit test only */
 static void unit_test(){
@@ -168,12 +593,44 @@ static void unit_test(){
  * Initialize: return -1 on error, 0 on success.
  */
 int mm_init(void) {
+    int result;
+    
+    LOCK();
+#ifdef MM_THREAD_HEAPS
+    result = reset_heaps();
+#else
+    result = init_heap();
+#endif
+#ifdef MM_THREADS
+    depot_reset();
+#endif
+#if defined(MM_THREADS) || defined(MM_THREAD_HEAPS)
+    __atomic_store_n(&heap_epoch, heap_epoch + 1, __ATOMIC_RELAXED);
+#endif
+    UNLOCK();
+    return result;
+}
+
+/*
+ * init_heap - Lay out the prologue and the first free chunk
+ */
+static int init_heap(void) {
     int i;
+    size_t size = MAX_CLASS*WSIZE+4*WSIZE;
+#ifdef MM_THREAD_HEAPS
+    char *bp;
+    
+    size = CHUNKSIZE;            /* Chunks are whole pages */
+#endif
     
     /* Create the initial empty heap */
-    if ((heap_listp = mem_sbrk(MAX_CLASS*WSIZE+2*MINIMUM)) == NULL)
+    if ((heap_listp = mem_sbrk(size)) == (void *)-1)
         return -1;
+#ifdef MM_THREAD_HEAPS
+    PUT(heap_listp, size);                       /* Chunk length */
+#else
     PUT(heap_listp, 0);                          /* Alignment padding */
+#endif
     PUT(heap_listp + WSIZE, PACK(MAX_CLASS*WSIZE+2*WSIZE, 1));   /* Prolog Header */
         
     for(i=0; i< MAX_CLASS; i++)
@@ -186,6 +643,14 @@ int mm_init(void) {
         
     }
     PUT(heap_listp + DSIZE + MAX_CLASS*WSIZE, PACK(MAX_CLASS*WSIZE+2*WSIZE, 1));   /* Prolog Footer */
+#ifdef MM_ADDR_ORDER
+    memset(skip_head, 0, sizeof(skip_head));
+#endif
+#ifdef MM_FIT_INDEX
+    fit_count = fit_overflow = 0;
+    if (fit_scan == NULL)
+        fit_scan = fit_scan_best();
+#endif
     
     PUT(heap_listp + WSIZE + MAX_CLASS*WSIZE+2*WSIZE, PACK(0, 1));     /* Epilogue header */
     
@@ -193,6 +658,32 @@ int mm_init(void) {
     free_listp = heap_listp + (2*WSIZE);
     
     heap_listp += (2*WSIZE);
+#ifdef MM_BITMAP
+    memset(map_start, 0, map_used * sizeof(uint64_t));
+    memset(map_alloc, 0, map_used * sizeof(uint64_t));
+    map_used = 0;
+    MAP_MARK(heap_listp);
+    MAP_USE(heap_listp, MAX_CLASS*WSIZE+2*WSIZE);
+    MAP_MARK(NEXT_BLKP(heap_listp));                 /* Epilogue */
+    MAP_USE(NEXT_BLKP(heap_listp), DSIZE);
+#endif
+    
+#ifdef MM_THREAD_HEAPS
+    /* The heap is my_heap; the rest of its first page is a free block */
+    set_page_owner(heap_listp - DSIZE, size);
+    my_heap->chunk = heap_listp - DSIZE;
+    my_heap->end = my_heap->chunk + size;
+    
+    bp = NEXT_BLKP(heap_listp);
+    size -= MAX_CLASS*WSIZE+4*WSIZE;
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+    insert_free_block(bp);
+    /* Published last: an arena is used as soon as listp is set */
+    __atomic_store_n(&my_heap->listp, heap_listp, __ATOMIC_RELEASE);
+    return 0;
+#endif
     
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
     if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
@@ -206,91 +697,1065 @@ int mm_init(void) {
     return 0;
 }
 
+#ifdef MM_THREADS
 /*
- * malloc
+ * depot_reset - Empty every depot, along with the heap they point into
  */
-void *malloc (size_t size) {
-    size_t asize;      /* Adjusted block size */
-    size_t extendsize; /* Amount to extend heap if no fit */
-    char *bp;
-    
-    
+static void depot_reset(void)
+{
+    int bin;
     
-    if (free_listp == 0){ // instantiate free list
-        mm_init();
+    for (bin = 0; bin < TCACHE_BINS; bin++) {
+#ifdef MM_CLASS_LOCKS
+        pthread_mutex_init(&depot[bin].lock, NULL);
+        depot[bin].head = NULL;
+#else
+        depot[bin].head = 0;
+#endif
     }
-    /* Ignore spurious requests */
-    if (size <= 0)
-        return NULL;
-    
-    /* Adjust block size to include overhead and alignment reqs. */
-    asize = MAX(ALIGN(size) + DSIZE, MINIMUM);
+    depot_bytes = 0;
+}
+
+#ifdef MM_CLASS_LOCKS
+/*
+ * depot_push - Push the blocks, of bytes in all, linked from first to
+ *      last onto a bin's depot
+ */
+static inline void depot_push(int bin, char *first, char *last, size_t bytes)
+{
+    depot_t *d = &depot[bin];
     
-    dbg_printf("Malloc of size %zu\n",asize);
+    pthread_mutex_lock(&d->lock);
+    *(char **)last = d->head;
+    d->head = first;
+    pthread_mutex_unlock(&d->lock);
+    __atomic_fetch_add(&depot_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+/*
+ * depot_pop - Pop a block off a bin's depot, or return NULL if it is empty
+ */
+static inline char *depot_pop(int bin)
+{
+    depot_t *d = &depot[bin];
+    char *bp;
     
-    /* comment out adjust from implicit version
-    if (size <= DSIZE)
-        asize = 2*DSIZE;                                        
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE); 
-    */
+    pthread_mutex_lock(&d->lock);
+    if ((bp = d->head) != NULL)
+        d->head = *(char **)bp;
+    pthread_mutex_unlock(&d->lock);
+    if (bp != NULL)
+        __atomic_fetch_sub(&depot_bytes, GET_SIZE(HDRP(bp)), __ATOMIC_RELAXED);
+    return bp;
+}
+#else
+/*
+ * depot_push - Push the blocks, of bytes in all, linked from first to
+ *      last onto a bin's depot
+ */
+static inline void depot_push(int bin, char *first, char *last, size_t bytes)
+{
+    depot_t *d = &depot[bin];
+    uint64_t old = __atomic_load_n(&d->head, __ATOMIC_RELAXED), new;
+    
+    do {
+        *(char **)last = (uint32_t)old ? DEPOT_PTR(old) : NULL;
+        new = DEPOT_HEAD(first, (old >> 32) + 1);
+    } while (!__atomic_compare_exchange_n(&d->head, &old, new, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    __atomic_fetch_add(&depot_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+/*
+ * depot_pop - Pop a block off a bin's depot, or return NULL if it is empty
+ */
+static inline char *depot_pop(int bin)
+{
+    depot_t *d = &depot[bin];
+    uint64_t old = __atomic_load_n(&d->head, __ATOMIC_ACQUIRE), new;
+    char *bp, *next;
+    
+    do {
+        if ((uint32_t)old == 0)
+            return NULL;
+        bp = DEPOT_PTR(old);
+        /* Another thread may pop bp and reuse it before our swap, in
+           which case next is garbage, but the tag has moved on too */
+        next = __atomic_load_n((char **)bp, __ATOMIC_RELAXED);
+        new = DEPOT_HEAD(next, (old >> 32) + 1);
+    } while (!__atomic_compare_exchange_n(&d->head, &old, new, 1,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+    __atomic_fetch_sub(&depot_bytes, GET_SIZE(HDRP(bp)), __ATOMIC_RELAXED);
+    return bp;
+}
+#endif
+
+/*
+ * depot_drain - Free every block in the depots, and in this thread's
+ *      cache, back to the heap, where it can coalesce; called with
+ *      heap_lock held before the heap grows or after a large free.
+ *      Returns the number of blocks freed.
+ */
+static int depot_drain(void)
+{
+    char *bp;
+    int bin, n = 0;
+    
+    if (tcache.epoch == __atomic_load_n(&heap_epoch, __ATOMIC_RELAXED))
+        for (bin = 0; bin < TCACHE_BINS; bin++)
+            for (; tcache.count[bin] > 0; tcache.count[bin]--, n++) {
+                bp = tcache.head[bin];
+                tcache.head[bin] = *(char **)bp;
+                free_block(bp);
+            }
+    if (__atomic_load_n(&depot_bytes, __ATOMIC_RELAXED) == 0)
+        return n;
+    for (bin = 0; bin < TCACHE_BINS; bin++)
+        while ((bp = depot_pop(bin)) != NULL) {
+            free_block(bp);
+            n++;
+        }
+    return n;
+}
+
+/*
+ * tcache_flush - Move up to n blocks of a bin to its depot, or to the
+ *      heap if the depots already hold DEPOT_BYTES
+ */
+static void tcache_flush(int bin, int n)
+{
+    char *first, *last, *bp;
+    size_t bytes;
+    int i;
     
+    if (n > tcache.count[bin])
+        n = tcache.count[bin];
+    if (n == 0)
+        return;
     
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {  
-        place(bp, asize);
-        mm_checkheap(1);
-        return bp;
+    first = last = tcache.head[bin];
+    bytes = GET_SIZE(HDRP(last));
+    for (i = 1; i < n; i++) {
+        last = *(char **)last;
+        bytes += GET_SIZE(HDRP(last));
+    }
+    if (__atomic_load_n(&depot_bytes, __ATOMIC_RELAXED) + bytes <= DEPOT_BYTES) {
+        tcache.head[bin] = *(char **)last;
+        tcache.count[bin] -= n;
+        depot_push(bin, first, last, bytes);
+        return;
     }
     
-    dbg_printf("No fit found\n");
-    
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize,CHUNKSIZE);                 
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
-        return NULL;                                  
-    place(bp, asize);
-    
-    mm_checkheap(1);
-    
-    return bp;
+    LOCK();
+    for (; n > 0; n--) {
+        bp = tcache.head[bin];
+        tcache.head[bin] = *(char **)bp;
+        tcache.count[bin]--;
+        free_block(bp);
+    }
+    UNLOCK();
 }
 
 /*
- * free
+ * tcache_exit - Hand on a thread's cached blocks when it exits
  */
-void free (void *ptr) {
+static void tcache_exit(void *arg)
+{
+    int bin;
     
-    if(ptr == 0)
+    arg = arg; /* Get gcc to be quiet */
+    if (tcache.epoch != __atomic_load_n(&heap_epoch, __ATOMIC_RELAXED))
         return;
+    for (bin = 0; bin < TCACHE_BINS; bin++)
+        tcache_flush(bin, tcache.count[bin]);
+}
+
+static void tcache_make_key(void)
+{
+    pthread_key_create(&tcache_key, tcache_exit);
+}
+
+/*
+ * tcache_check - Drop the blocks cached from a heap that mm_init has
+ *      since thrown away
+ */
+static inline void tcache_check(void)
+{
+    unsigned epoch = __atomic_load_n(&heap_epoch, __ATOMIC_RELAXED);
     
-    dbg_printf("free %p\n",ptr);
-    size_t size = GET_SIZE(HDRP(ptr));
-    
-    if (free_listp == 0){
-        mm_init();
+    if (tcache.epoch != epoch) {
+        memset(&tcache, 0, sizeof(tcache));
+        tcache.epoch = epoch;
+        pthread_once(&tcache_once, tcache_make_key);
+        pthread_setspecific(tcache_key, &tcache);
     }
+}
+
+/*
+ * tcache_get - Take a block of asize bytes from this thread's cache,
+ *      refilling the bin with a batch of blocks from its depot if it is
+ *      empty. The heap gives only the block asked for, since a cached
+ *      block can't coalesce. Returns NULL if asize is too big to be cached.
+ */
+static inline void *tcache_get(size_t asize)
+{
+    size_t bin = TCACHE_BIN(asize);
+    char *bp;
     
-    
-    PUT(HDRP(ptr), PACK(size, 0));
-    PUT(FTRP(ptr), PACK(size, 0));
-    coalesce(ptr);
-    //mm_checkheap(1);
+    if (bin >= TCACHE_BINS)
+        return NULL;
+    tcache_check();
+    
+    if (tcache.count[bin] == 0) {
+        while (tcache.count[bin] < TCACHE_BATCH &&
+               (bp = depot_pop(bin)) != NULL) {
+            *(char **)bp = tcache.head[bin];
+            tcache.head[bin] = bp;
+            tcache.count[bin]++;
+        }
+    }
+    if (tcache.count[bin] == 0) {
+        LOCK();
+        if (free_listp == 0)
+            init_heap();
+        bp = alloc_block(asize);
+        UNLOCK();
+        if (bp == NULL)
+            return NULL;
+    }
+    else {
+        bp = tcache.head[bin];
+        tcache.head[bin] = *(char **)bp;
+        tcache.count[bin]--;
+    }
+    if (GROWTH(HDRP(bp)) != 0)
+        PUT_GROWTH(bp, 0);
+    return bp;
 }
 
-static inline void *coalesce(void *bp)
+/*
+ * tcache_put - Keep a freed block of at least size bytes in this
+ *      thread's cache, first flushing a batch to the heap if the bin is
+ *      full. Returns 0 if the block is too big to be cached.
+ */
+static inline int tcache_put(void *bp, size_t size)
 {
+    size_t bin = TCACHE_BIN(size);
     
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))) || PREV_BLKP(bp) == bp; //possible to remove second clause
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-    size_t size = GET_SIZE(HDRP(bp));
+    if (bin >= TCACHE_BINS)
+        return 0;
+    tcache_check();
+    
+    if (tcache.count[bin] == TCACHE_MAX)
+        tcache_flush(bin, TCACHE_BATCH);
+    *(char **)bp = tcache.head[bin];
+    tcache.head[bin] = bp;
+    tcache.count[bin]++;
+    return 1;
+}
+
+/*
+ * now_ms - Milliseconds on a monotonic clock
+ */
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
     
-    dbg_printf("Begin coalesce at %p\n",bp);
-	/* Case 1, coalesce with previous block */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * purge_pass - Give back to the OS the pages of free blocks that have
+ *      aged. Over the decay time a block's pages go back in proportion
+ *      to its age, from its end inwards, so that recently freed memory
+ *      stays resident for reuse. Returns the advice to use next time,
+ *      which is MADV_DONTNEED if advice failed.
+ */
+static int purge_pass(int decay, int advice)
+{
+    uint64_t now, age;
+    size_t pages, target;
+    char *bp, *hi;
+    int class;
+    
+    LOCK();
+    now = now_ms();     /* No block on the lists is newer */
+    for (class = find_minimum_class(PURGE_MIN);
+         free_listp != 0 && class <= MAX_CLASS; class++) {
+        for (bp = get_head_classp(class); bp != NULL; bp = NEXT_FREEP(bp)) {
+            if (GET_SIZE(HDRP(bp)) < PURGE_MIN)
+                continue;
+            pages = page_span(bp, &hi);
+            age = now - FREED_AT(bp);
+            target = (age >= (uint64_t)decay) ? pages : pages * age / decay;
+            if (target <= PURGED(bp))
+                continue;
+            
+            /* MADV_FREE needs Linux 4.5 and private anonymous memory */
+            if (madvise(hi - target*CHUNKSIZE, (target - PURGED(bp))*CHUNKSIZE,
+                        advice) == -1 && advice != MADV_DONTNEED) {
+                advice = MADV_DONTNEED;
+                madvise(hi - target*CHUNKSIZE, (target - PURGED(bp))*CHUNKSIZE,
+                        advice);
+            }
+            PURGED(bp) = target;
+        }
+    }
+    UNLOCK();
+    return advice;
+}
+
+/*
+ * purge_main - Run a purge pass PURGE_STEPS times per decay time until
+ *      mm_purge_stop
+ */
+static void *purge_main(void *arg)
+{
+    struct timespec wake;
+    long step;
+    int decay, advice, next;
+    
+    arg = arg; /* Get gcc to be quiet */
+    pthread_mutex_lock(&purge_lock);
+    while (purge_decay > 0) {
+        decay = purge_decay;
+        advice = purge_advice;
+        pthread_mutex_unlock(&purge_lock);
+        next = purge_pass(decay, advice);
+        pthread_mutex_lock(&purge_lock);
+        /* Unless mm_purge_start asked for other advice meanwhile */
+        if (purge_advice == advice)
+            purge_advice = next;
+        
+        step = MAX(purge_decay / PURGE_STEPS, 1);
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_sec += step / 1000;
+        wake.tv_nsec += (step % 1000) * 1000000;
+        if (wake.tv_nsec >= 1000000000) {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000;
+        }
+        if (purge_decay > 0)
+            pthread_cond_timedwait(&purge_wake, &purge_lock, &wake);
+    }
+    pthread_mutex_unlock(&purge_lock);
+    return NULL;
+}
+
+/*
+ * mm_purge_start - Start the purge thread, or change its decay time
+ *      and advice if it is running
+ */
+int mm_purge_start(int decay_ms, int lazy)
+{
+    int result = 0;
+    
+    if (decay_ms <= 0)
+        return -1;
+    pthread_mutex_lock(&purge_lock);
+    purge_advice = lazy ? MADV_FREE : MADV_DONTNEED;
+    if (purge_decay == 0 &&
+        pthread_create(&purge_thread, NULL, purge_main, NULL) != 0)
+        result = -1;
+    else
+        __atomic_store_n(&purge_decay, decay_ms, __ATOMIC_RELAXED);
+    pthread_cond_signal(&purge_wake);
+    pthread_mutex_unlock(&purge_lock);
+    return result;
+}
+
+/*
+ * mm_purge_stop - Stop the purge thread and wait for it to exit
+ */
+void mm_purge_stop(void)
+{
+    int running;
+    
+    pthread_mutex_lock(&purge_lock);
+    running = purge_decay > 0;
+    __atomic_store_n(&purge_decay, 0, __ATOMIC_RELAXED);
+    pthread_cond_signal(&purge_wake);
+    pthread_mutex_unlock(&purge_lock);
+    if (running)
+        pthread_join(purge_thread, NULL);
+}
+#elif defined(MM_THREAD_HEAPS)
+/*
+ * set_page_owner - Record that the pages of a new chunk belong to my_heap
+ */
+static void set_page_owner(char *chunk, size_t size)
+{
+    size_t i;
+    
+    for (i = 0; i < size; i += CHUNKSIZE)
+        page_owner[PAGE_INDEX(chunk + i)] = my_heap - heaps + 1;
+}
+
+/*
+ * reset_heaps - Forget every heap; each thread makes or adopts a new
+ *      one on its next malloc
+ */
+static int reset_heaps(void)
+{
+    int i;
+    
+    for (i = 0; i < MAX_HEAPS; i++) {
+        heaps[i].listp = NULL;
+        heaps[i].remote = NULL;
+        heaps[i].users = 0;
+    }
+    memset(page_owner, 0, sizeof(page_owner));
+#ifdef MM_CPU_ARENAS
+    narenas = sysconf(_SC_NPROCESSORS_CONF);
+    if (narenas < 1)
+        narenas = 1;
+    if (narenas > MAX_HEAPS)
+        narenas = MAX_HEAPS;
+#endif
+    return 0;
+}
+
+#ifdef MM_CPU_ARENAS
+/*
+ * arena_create - Lay out the empty arena h, unless another thread just
+ *      has. Returns -1 if it can't be made.
+ */
+static int arena_create(heap_t *h)
+{
+    int result = 0;
+    
+    LOCK();
+    if (h->listp == NULL) {
+        pthread_mutex_init(&h->lock, NULL);
+        my_heap = h;
+        result = init_heap();
+    }
+    UNLOCK();
+    return result;
+}
+
+/*
+ * heap_get - The arena of the CPU the thread is running on. sched_getcpu
+ *      is cheap where glibc reads it from the thread's rseq area. If the
+ *      thread has migrated by the time it takes the arena's lock, it
+ *      costs no more than the contention of sharing the arena.
+ */
+static inline heap_t *heap_get(void)
+{
+    int cpu = sched_getcpu();
+    heap_t *h = &heaps[(cpu < 0 ? 0 : cpu) % narenas];
+    
+    if (__atomic_load_n(&h->listp, __ATOMIC_ACQUIRE) == NULL &&
+        arena_create(h) == -1)
+        return NULL;
+    return h;
+}
+
+/*
+ * heap_lock - Lock h to allocate from it
+ */
+static inline void heap_lock(heap_t *h)
+{
+    pthread_mutex_lock(&h->lock);
+    my_heap = h;
+    heap_listp = h->listp;
+}
+
+/*
+ * heap_enter - Lock h to free one of its blocks, or return 0 if the
+ *      block should go on h's remote stack instead because h is busy
+ */
+static inline int heap_enter(heap_t *h)
+{
+    if (pthread_mutex_trylock(&h->lock) != 0)
+        return 0;
+    my_heap = h;
+    heap_listp = h->listp;
+    return 1;
+}
+#else
+/*
+ * heap_detach - Leave the thread's heap to be adopted when it exits.
+ *      Its blocks stay where they are, and frees of them keep going to
+ *      its remote stack.
+ */
+static void heap_detach(void *arg)
+{
+    heap_t *h = arg;
+    
+    LOCK();
+    if (my_epoch == heap_epoch)
+        h->users--;
+    UNLOCK();
+}
+
+static void heap_make_key(void)
+{
+    pthread_key_create(&heap_key, heap_detach);
+}
+
+/*
+ * heap_attach - Give the thread a heap: one an exited thread left,
+ *      else a new one, else (with MAX_HEAPS heaps in use) the heap with
+ *      the fewest users. Returns NULL if a new heap can't be made.
+ */
+static heap_t *heap_attach(void)
+{
+    heap_t *h = NULL;
+    int i;
+    
+    pthread_once(&heap_once, heap_make_key);
+    
+    LOCK();
+    for (i = 0; i < MAX_HEAPS && h == NULL; i++)
+        if (heaps[i].listp != NULL && heaps[i].users == 0)
+            h = &heaps[i];
+    for (i = 0; i < MAX_HEAPS && h == NULL; i++)
+        if (heaps[i].listp == NULL)
+            h = &heaps[i];
+    if (h == NULL) {
+        h = &heaps[0];
+        for (i = 1; i < MAX_HEAPS; i++)
+            if (heaps[i].users < h->users)
+                h = &heaps[i];
+    }
+    
+    my_heap = h;
+    if (h->listp == NULL) {
+        pthread_mutex_init(&h->lock, NULL);
+        if (init_heap() == -1) {
+            h->listp = NULL;
+            my_heap = NULL;
+            UNLOCK();
+            return NULL;
+        }
+    }
+    h->users++;
+    heap_listp = free_listp = h->listp;
+    my_epoch = heap_epoch;
+    UNLOCK();
+    
+    pthread_setspecific(heap_key, h);
+    return h;
+}
+
+/*
+ * heap_get - The thread's heap, attaching one if it has none
+ */
+static inline heap_t *heap_get(void)
+{
+    if (my_heap != NULL &&
+        my_epoch == __atomic_load_n(&heap_epoch, __ATOMIC_RELAXED))
+        return my_heap;
+    return heap_attach();
+}
+
+/*
+ * heap_lock - Lock h, the thread's heap, to allocate from it
+ */
+static inline void heap_lock(heap_t *h)
+{
+    pthread_mutex_lock(&h->lock);
+}
+
+/*
+ * heap_enter - Lock h to free one of its blocks, or return 0 if the
+ *      block should go on h's remote stack instead because h is
+ *      another thread's
+ */
+static inline int heap_enter(heap_t *h)
+{
+    if (h != my_heap ||
+        my_epoch != __atomic_load_n(&heap_epoch, __ATOMIC_RELAXED))
+        return 0;
+    pthread_mutex_lock(&h->lock);
+    return 1;
+}
+#endif
+
+/*
+ * chunk_sbrk - Grow my_heap by at least *sizep bytes, in whole pages.
+ *      Returns the block pointer of the free block they make, and its
+ *      size in *sizep. If another heap took the pages just past ours,
+ *      the new ones become a chunk of their own behind a fence block.
+ */
+static char *chunk_sbrk(size_t *sizep)
+{
+    heap_t *h = my_heap;
+    size_t size = (*sizep + 2*DSIZE + CHUNKSIZE-1) & ~(size_t)(CHUNKSIZE-1);
+    char *c;
+    
+    LOCK();
+    if (((mem_heapsize() + size) >> PAGE_SHIFT) > MAX_PAGES ||
+        (c = mem_sbrk(size)) == (void *)-1) {
+        UNLOCK();
+        return NULL;
+    }
+    set_page_owner(c, size);
+    if (c == h->end) {
+        /* Contiguous: the new free block starts over the old epilogue */
+        PUT(h->chunk, GET(h->chunk) + size);
+        h->end = c + size;
+    }
+    else {
+        PUT(c, size);                           /* Chunk length */
+        PUT(c + WSIZE, PACK(DSIZE, 1));         /* Fence header */
+        PUT(c + DSIZE, PACK(DSIZE, 1));         /* Fence footer */
+        h->chunk = c;
+        h->end = c + size;
+        c += 2*DSIZE;
+        size -= 2*DSIZE;
+    }
+    UNLOCK();
+    
+    *sizep = size;
+    return c;
+}
+
+/*
+ * remote_free - Hand a block to the heap that owns it without taking
+ *      its lock, by pushing it onto the heap's stack of remote frees.
+ *      The block stays marked allocated until the owner drains it.
+ */
+static inline void remote_free(heap_t *h, char *bp)
+{
+    char *head = __atomic_load_n(&h->remote, __ATOMIC_RELAXED);
+    
+    do {
+        *(char **)bp = head;
+    } while (!__atomic_compare_exchange_n(&h->remote, &head, bp, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * remote_drain - Free the blocks other threads have pushed onto the
+ *      stack of the thread's heap, whose lock the caller holds. Taking
+ *      the whole stack in one exchange, rather than popping, means the
+ *      pushes can't be hit by ABA. Returns the number of blocks freed.
+ */
+static int remote_drain(void)
+{
+    char *bp, *next;
+    int n = 0;
+    
+    bp = __atomic_exchange_n(&my_heap->remote, NULL, __ATOMIC_ACQUIRE);
+    for (; bp != NULL; bp = next, n++) {
+        next = *(char **)bp;
+        free_block(bp);
+    }
+    return n;
+}
+#endif
+
+/*
+ * malloc
+ */
+void *malloc (size_t size) {
+    size_t asize;      /* Adjusted block size */
+    char *bp;
+#ifdef MM_THREAD_HEAPS
+    heap_t *h;
+#endif
+    
+    /* Ignore spurious requests */
+    if (size <= 0)
+        return NULL;
+    
+    /* Adjust block size to include overhead and alignment reqs. */
+    asize = MAX(ALIGN(size) + DSIZE, MINIMUM);
+    
+    dbg_printf("Malloc of size %zu\n",asize);
+    
+#ifdef MM_THREADS
+    if ((bp = tcache_get(asize)) != NULL)
+        return bp;
+#endif
+#ifdef MM_THREAD_HEAPS
+    if ((h = heap_get()) == NULL)
+        return NULL;
+    heap_lock(h);
+    bp = alloc_block(asize);
+    pthread_mutex_unlock(&h->lock);
+    return bp;
+#endif
+    
+    LOCK();
+    if (free_listp == 0){ // instantiate free list
+        init_heap();
+    }
+    bp = alloc_block(asize);
+    UNLOCK();
+    return bp;
+}
+
+/*
+ * alloc_block - Find or make a free block of asize bytes and allocate it
+ */
+static void *alloc_block(size_t asize) {
+    size_t extendsize; /* Amount to extend heap if no fit */
+    char *bp;
+    
+    /* comment out adjust from implicit version
+    if (size <= DSIZE)
+        asize = 2*DSIZE;                                        
+    else
+        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE); 
+    */
+    
+    
+    /* Search the free list for a fit */
+    bp = find_fit(asize);
+#ifdef MM_THREAD_HEAPS
+    /* Blocks other threads have freed may make one */
+    if (bp == NULL && remote_drain() > 0)
+        bp = find_fit(asize);
+#endif
+#ifdef MM_THREADS
+    /* So may the blocks parked in the depots and this thread's cache */
+    if (bp == NULL && depot_drain() > 0)
+        bp = find_fit(asize);
+#endif
+    if (bp != NULL) {  
+        bp = PLACE(bp, asize);
+        dbg_checkheap();
+        return bp;
+    }
+    
+    dbg_printf("No fit found\n");
+    
+    /* No fit found. Get more memory and place the block */
+    extendsize = MAX(asize,CHUNKSIZE);                 
+    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+        return NULL;                                  
+    bp = PLACE(bp, asize);
+    
+    dbg_checkheap();
+    
+    return bp;
+}
+
+/*
+ * alloc_high - alloc_block for a long-lived block, which is carved from
+ *      the end of the free block rather than the start
+ */
+static void *alloc_high(size_t asize) {
+    char *bp;
+    
+    bp = find_fit(asize);
+#ifdef MM_THREAD_HEAPS
+    if (bp == NULL && remote_drain() > 0)
+        bp = find_fit(asize);
+#endif
+#ifdef MM_THREADS
+    if (bp == NULL && depot_drain() > 0)
+        bp = find_fit(asize);
+#endif
+    if (bp == NULL &&
+        (bp = extend_heap(MAX(asize, CHUNKSIZE)/WSIZE)) == NULL)
+        return NULL;
+    bp = place_high(bp, asize);
+    
+    dbg_checkheap();
+    return bp;
+}
+
+/*
+ * mm_malloc_hint - malloc, told how long the block will live. Long-lived
+ *      blocks go at the high end of free blocks and short-lived ones at
+ *      the low end, so that the short-lived ones free up runs of space
+ *      between them rather than holes.
+ */
+void *mm_malloc_hint(size_t size, int hint) {
+    size_t asize;
+    char *bp;
+#ifdef MM_THREAD_HEAPS
+    heap_t *h;
+#endif
+    
+    if (hint != MM_HINT_LONG || size == 0)
+        return malloc(size);
+    asize = MAX(ALIGN(size) + DSIZE, MINIMUM);
+    
+    /* The thread cache would hand out blocks from anywhere */
+#ifdef MM_THREAD_HEAPS
+    if ((h = heap_get()) == NULL)
+        return NULL;
+    heap_lock(h);
+    bp = alloc_high(asize);
+    pthread_mutex_unlock(&h->lock);
+    return bp;
+#endif
+    
+    LOCK();
+    if (free_listp == 0)
+        init_heap();
+    bp = alloc_high(asize);
+    UNLOCK();
+    return bp;
+}
+
+/*
+ * aligned_fit - Where in free block bp a block of asize bytes with its
+ *      payload at a multiple of alignment would go, or NULL if it
+ *      doesn't fit. Any slack in front must make a free block itself.
+ */
+static inline char *aligned_fit(char *bp, size_t asize, size_t alignment)
+{
+    size_t mask = alignment - 1;
+    char *a = (char *)(((size_t)bp + mask) & ~mask);
+    
+    if (a != bp && a - bp < MINIMUM)
+        a = (char *)(((size_t)bp + MINIMUM + mask) & ~mask);
+    if (a + asize > bp + GET_SIZE(HDRP(bp)))
+        return NULL;
+    return a;
+}
+
+/*
+ * find_aligned_fit - First fit for an aligned block, like find_fit
+ */
+static void *find_aligned_fit(size_t asize, size_t alignment)
+{
+    char *bp;
+    int cp;
+    
+    for (cp = find_minimum_class(asize); cp <= MAX_CLASS; cp++)
+        for (bp = get_head_classp(cp); bp != NULL; bp = NEXT_FREEP(bp))
+            if (aligned_fit(bp, asize, alignment) != NULL)
+                return bp;
+    return NULL;
+}
+
+/*
+ * alloc_aligned - alloc_block for a payload at a multiple of alignment.
+ *      The slack in front of it is split off as a free block of its own.
+ */
+static void *alloc_aligned(size_t asize, size_t alignment) {
+    char *bp, *a;
+    size_t csize;
+    
+    bp = find_aligned_fit(asize, alignment);
+#ifdef MM_THREAD_HEAPS
+    if (bp == NULL && remote_drain() > 0)
+        bp = find_aligned_fit(asize, alignment);
+#endif
+#ifdef MM_THREADS
+    if (bp == NULL && depot_drain() > 0)
+        bp = find_aligned_fit(asize, alignment);
+#endif
+    if (bp == NULL) {
+        csize = MAX(asize + alignment + MINIMUM, CHUNKSIZE);
+        if ((bp = extend_heap(csize/WSIZE)) == NULL)
+            return NULL;
+    }
+    a = aligned_fit(bp, asize, alignment);
+    
+    if (a != bp) {
+        csize = GET_SIZE(HDRP(bp));
+        remove_free_block(bp);
+        PUT(HDRP(bp), PACK(a - bp, 0));
+        PUT(FTRP(bp), PACK(a - bp, 0));
+        MAP_UNUSE(bp, a - bp);
+        insert_free_block(bp);
+        PUT(HDRP(a), PACK(csize - (a - bp), 0));
+        PUT(FTRP(a), PACK(csize - (a - bp), 0));
+        MAP_MARK(a);
+        MAP_UNUSE(a, csize - (a - bp));
+        insert_free_block(a);
+    }
+    place(a, asize);
+    
+    dbg_checkheap();
+    return a;
+}
+
+/*
+ * free
+ */
+void free (void *ptr) {
+#ifdef MM_THREADS
+    size_t size;
+#endif
+#ifdef MM_THREAD_HEAPS
+    heap_t *h;
+#endif
+    
+    if(ptr == 0)
+        return;
+    
+    dbg_printf("free %p\n",ptr);
+    
+#ifdef MM_THREADS
+    if (tcache_put(ptr, GET_SIZE(HDRP(ptr))))
+        return;
+#endif
+#ifdef MM_THREAD_HEAPS
+    h = HEAP_OF(ptr);
+    if (!heap_enter(h)) {
+        remote_free(h, ptr);
+        return;
+    }
+    free_block(ptr);
+    pthread_mutex_unlock(&h->lock);
+    return;
+#endif
+    
+    LOCK();
+    if (free_listp == 0){
+        init_heap();
+    }
+#ifdef MM_THREADS
+    size = GET_SIZE(HDRP(ptr));
+#endif
+    free_block(ptr);
+#ifdef MM_THREADS
+    /* Room this big is what cached blocks break up; let them merge */
+    if (size >= CHUNKSIZE)
+        depot_drain();
+#endif
+    UNLOCK();
+}
+
+#ifdef MM_THREADS
+/*
+ * free_sized - free, told the size that was asked for at ptr. The block
+ *      may be bigger than that (see place), so only the cache, whose
+ *      bins just need a lower bound, can go without reading the header;
+ *      blocks too big for it are freed as by free. Builds without the
+ *      cache have no use for the size and don't define this.
+ */
+void free_sized(void *ptr, size_t size) {
+    if (ptr != 0 && size > 0 &&
+        tcache_put(ptr, MAX(ALIGN(size) + DSIZE, MINIMUM)))
+        return;
+    free(ptr);
+}
+#endif
+
+/*
+ * free_run - Free the allocated blocks from bp up to (not including) end,
+ *      which are neighbours, as one block
+ */
+static void free_run(char *bp, char *end) {
+#ifdef MM_BITMAP
+    map_set(map_start, GRANULE(bp) + 1, GRANULE(end), 0);
+#endif
+    PUT(HDRP(bp), PACK(end - bp, 1));
+    free_block(bp);
+}
+
+static int cmp_ptr(const void *a, const void *b)
+{
+    char *x = *(char * const *)a, *y = *(char * const *)b;
+    
+    return (x > y) - (x < y);
+}
+
+/*
+ * free_sorted - Free the n blocks in p (NULLs allowed), taking the lock
+ *      once. p is sorted by address first, so that blocks which
+ *      neighbour each other are freed as a single block and coalesced
+ *      only once.
+ */
+static void free_sorted(char **p, size_t n) {
+    char *bp, *end;
+    size_t i, j;
+#ifdef MM_THREAD_HEAPS
+    heap_t *h, *locked = NULL;
+#endif
+    
+    qsort(p, n, sizeof(char *), cmp_ptr);
+    for (i = 0; i < n && p[i] == NULL; i++)
+        ;
+    
+#ifdef MM_THREAD_HEAPS
+    /* Runs in our own heap are merged; others go back one by one */
+    for (; i < n; i = j) {
+        bp = p[i];
+        h = HEAP_OF(bp);
+        if (h != locked) {
+            if (locked != NULL)
+                pthread_mutex_unlock(&locked->lock);
+            locked = heap_enter(h) ? h : NULL;
+        }
+        if (locked == NULL) {
+            remote_free(h, bp);
+            j = i + 1;
+            continue;
+        }
+        for (j = i + 1, end = NEXT_BLKP(bp); j < n && p[j] == end; j++)
+            end = NEXT_BLKP(end);
+        free_run(bp, end);
+    }
+    if (locked != NULL)
+        pthread_mutex_unlock(&locked->lock);
+    return;
+#endif
+    
+    if (i == n)
+        return;
+    LOCK();
+    for (; i < n; i = j) {
+        bp = p[i];
+        for (j = i + 1, end = NEXT_BLKP(bp); j < n && p[j] == end; j++)
+            end = NEXT_BLKP(end);
+        free_run(bp, end);
+    }
+    UNLOCK();
+}
+
+/*
+ * free_batch - Free the n blocks in ptrs (NULLs allowed), FREE_CHUNK at a
+ *      time. Each chunk is sorted in a copy, so ptrs is left as it was.
+ */
+void free_batch(void **ptrs, size_t n) {
+    char *p[FREE_CHUNK];
+    size_t k;
+    
+    for (; n > 0; ptrs += k, n -= k) {
+        k = MIN(n, FREE_CHUNK);
+        memcpy(p, ptrs, k * sizeof(char *));
+        free_sorted(p, k);
+    }
+}
+
+/*
+ * free_block - Mark an allocated block free and coalesce it
+ */
+static void free_block(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    MAP_UNUSE(bp, size);
+    coalesce(bp);
+    //mm_checkheap(1);
+}
+
+static inline void *coalesce(void *bp)
+{
+    
+#ifdef MM_BITMAP
+    /* The maps answer for the neighbours without touching their tags */
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = MAP_TEST(map_alloc, GRANULE(bp) - 1);
+    size_t next_alloc = MAP_TEST(map_alloc, GRANULE(bp) + size/DSIZE);
+#else
+    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))) || PREV_BLKP(bp) == bp; //possible to remove second clause
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+#endif
+    /* The merged block ends where a free next block did */
+    size_t purged = next_alloc ? 0 : PURGED_PAGES(NEXT_BLKP(bp));
+    
+    dbg_printf("Begin coalesce at %p\n",bp);
+	/* Case 1, coalesce with previous block */
 	if (prev_alloc && !next_alloc)
 	{
 		size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
 		remove_free_block(NEXT_BLKP(bp));
+		MAP_UNMARK(NEXT_BLKP(bp));
 		PUT(HDRP(bp), PACK(size, 0));
 		PUT(FTRP(bp), PACK(size, 0));
 	}
@@ -299,6 +1764,7 @@ static inline void *coalesce(void *bp)
 	else if (!prev_alloc && next_alloc)
 	{
 		size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+		MAP_UNMARK(bp);
 		bp = PREV_BLKP(bp);
 		remove_free_block(bp);
 		PUT(HDRP(bp), PACK(size, 0));
@@ -312,15 +1778,16 @@ static inline void *coalesce(void *bp)
         GET_SIZE(HDRP(NEXT_BLKP(bp)));
 		remove_free_block(PREV_BLKP(bp));
 		remove_free_block(NEXT_BLKP(bp));
+		MAP_UNMARK(NEXT_BLKP(bp));
+		MAP_UNMARK(bp);
 		bp = PREV_BLKP(bp);
 		PUT(HDRP(bp), PACK(size, 0));
 		PUT(FTRP(bp), PACK(size, 0));
 	}
     
 	//insert free block at the beginning of free list
-    current_class = find_minimum_class(size);
-    dbg_printf("current class = %d\n",current_class);
     insert_free_block(bp);
+    keep_purged(bp, purged);
     //mm_checkheap(1);
     dbg_printf("end coalescing\n");
     return bp;
@@ -330,7 +1797,7 @@ static inline void *coalesce(void *bp)
  * realloc - you may want to look at mm-naive.c
  */
 void *realloc(void *oldptr, size_t size) {
-    size_t oldsize;
+    size_t oldsize, growth;
     void *newptr;
     size_t asize = MAX(ALIGN(size) + DSIZE, MINIMUM);
     
@@ -347,9 +1814,14 @@ void *realloc(void *oldptr, size_t size) {
     
     /* Get the size of the original block */
 	oldsize = GET_SIZE(HDRP(oldptr));
-    
-	/* If the size doesn't need to be changed, return original pointer */
-	if (asize == oldsize)
+	growth = GROWTH(HDRP(oldptr));
+    
+	/* If it still fits in the usable size, with too little left over
+	 * to split off as a free block, return original pointer. A block
+	 * that has been growing keeps its slack unless it shrinks to less
+	 * than half, when the slack goes back (and it counts as new). */
+	if (size <= oldsize - DSIZE &&
+	    (oldsize - asize < MINIMUM || (growth > 0 && asize > oldsize / 2)))
 		return oldptr;
     
 	/* If the size needs to be decreased, shrink the block and
@@ -357,185 +1829,961 @@ void *realloc(void *oldptr, size_t size) {
 	if(asize <= oldsize)
 	{
 		size = asize;
-        
-		/* If the remaining space is not enough for a minimum free block size
-		 * return the original pointer 
-         */
-		if(oldsize - size <= MINIMUM)
-			return oldptr;
+#ifdef MM_THREAD_HEAPS
+        /* The remainder joins the owner's lists, so it must be free to split */
+        if (!heap_enter(HEAP_OF(oldptr)))
+            return oldptr;
+#else
+        LOCK();
+#endif
 		PUT(HDRP(oldptr), PACK(size, 1));
 		PUT(FTRP(oldptr), PACK(size, 1));
 		PUT(HDRP(NEXT_BLKP(oldptr)), PACK(oldsize-size, 1));
+		MAP_USE(oldptr, size);
+		MAP_MARK(NEXT_BLKP(oldptr));
         
         // free the remaing space after shrinking the block
-		free(NEXT_BLKP(oldptr));
+		free_block(NEXT_BLKP(oldptr));
+#ifdef MM_THREAD_HEAPS
+        pthread_mutex_unlock(&my_heap->lock);
+#else
+        UNLOCK();
+#endif
 		return oldptr;
 	}
     
 	//If we can not fit the new block in the old block, then we need to allocate new free block elsewhere
-    newptr = malloc(size);
+	/* A block that grows again and again is probably an array being
+	 * appended to, so it gets room for half as much again */
+	growth = MIN(growth + 1, GROW_MAX);
+	if (growth >= GROW_AFTER)
+		newptr = malloc(size + size / 2);
+	else
+		newptr = malloc(size);
     
 	/* If malloc() fails,return NULL  */
 	if(!newptr) {
 		return 0;
 	}
+	PUT_GROWTH(newptr, growth);
+    
+	/* Copy the old data. */
+	oldsize -= DSIZE;
+	if(size < oldsize) oldsize = size;
+	memcpy(newptr, oldptr, oldsize);
+    
+	/* Free the old block. */
+	free(oldptr);
+
+    //mm_checkheap(1);
+    return newptr;
+}
+
+
+
+/*
+ * extend_heap - Extend heap with free block and return its block pointer
+ */
+static inline void *extend_heap(size_t words)
+{
+    char *bp;
+    size_t size;
+    
+    /* Allocate an even number of words to maintain alignment */
+    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE; 
+    
+    if(size < MINIMUM)
+        size = MINIMUM;
+    
+#ifdef MM_THREAD_HEAPS
+    if ((bp = chunk_sbrk(&size)) == NULL)
+        return NULL;
+#else
+#ifdef MM_BITMAP
+    if (mem_heapsize() + size >= MAP_SPAN)
+        return NULL;
+#endif
+    if ((long)(bp = mem_sbrk(size)) == -1)
+        return NULL;
+#endif
+    
+    dbg_printf("extend_heap of size %zu\n",size);
+    
+    /* Initialize free block header/footer and the epilogue header */
+    PUT(HDRP(bp), PACK(size, 0));         /* Free block header */   
+    PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */   
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */ 
+    MAP_UNUSE(bp, size);                  /* The old epilogue starts bp */
+    MAP_MARK(NEXT_BLKP(bp));
+    MAP_USE(NEXT_BLKP(bp), DSIZE);
+    
+    dbg_checkheap();
+    /* Coalesce if the previous block was free */
+    return coalesce(bp);                                         
+}
+
+/*
+ * keeps_node - Can a free block of csize bytes, cut down to rsize, keep
+ *      its node on the free lists? Only if it stays in the same class,
+ *      and with MM_ADDR_ORDER or MM_FIT_INDEX not in the largest class,
+ *      where the block's skip list links or index slot sit at its end
+ *      and depend on its address and size.
+ */
+static inline int keeps_node(size_t csize, size_t rsize)
+{
+    int class = find_minimum_class(csize);
+    
+    if (rsize < MINIMUM || find_minimum_class(rsize) != class)
+        return 0;
+#if defined(MM_ADDR_ORDER) || defined(MM_FIT_INDEX)
+    if (class == MAX_CLASS)
+        return 0;
+#endif
+    return 1;
+}
+
+/*
+ * move_free_node - Free block to, whose tags are written, takes over the
+ *      place of free block from on its class list
+ */
+static inline void move_free_node(char *from, char *to)
+{
+    char *prev = PREV_FREEP(from), *next = NEXT_FREEP(from);
+    
+    PREV_FREEP(to) = prev;
+    NEXT_FREEP(to) = next;
+    if (prev)
+        NEXT_FREEP(prev) = to;
+    else
+        SET_HEAD_CLASSP(to, find_minimum_class(GET_SIZE(HDRP(to))));
+    if (next)
+        PREV_FREEP(next) = to;
+    stamp_freed(to);
+}
+
+/*
+ * Place block of asize bytes at start of free block bp
+ * Then split if remainder is at least a minimum block size
+ */
+
+static inline void place(void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t purged = PURGED_PAGES(bp);   /* kept by the remainder */
+    char *rest;
+    dbg_printf("begin place at %p, size %zu\n",bp,asize);
+    
+    /* A remainder of the same class just moves bp's list node up */
+    if (keeps_node(csize, csize - asize)) {
+        rest = (char *)bp + asize;
+        PUT(HDRP(rest), PACK(csize-asize, 0));
+        PUT(FTRP(rest), PACK(csize-asize, 0));
+        move_free_node(bp, rest);
+        keep_purged(rest, purged);
+        PUT(HDRP(bp), PACK(asize, 1));
+        PUT(FTRP(bp), PACK(asize, 1));
+        MAP_USE(bp, asize);
+        MAP_MARK(rest);
+        MAP_UNUSE(rest, csize-asize);
+        return;
+    }
+    
+    /* Unlink bp first: its size says which class list it is on */
+    remove_free_block(bp);
+    
+    if ((csize - asize) >= MINIMUM) {
+        PUT(HDRP(bp), PACK(asize, 1));
+        PUT(FTRP(bp), PACK(asize, 1));
+        MAP_USE(bp, asize);
+        
+        
+        bp = NEXT_BLKP(bp);
+        dbg_printf("\n\n begin split block at %p, size %zu\n",bp,asize);
+        
+        PUT(HDRP(bp), PACK(csize-asize, 0));
+        PUT(FTRP(bp), PACK(csize-asize, 0));
+        MAP_MARK(bp);
+        MAP_UNUSE(bp, csize-asize);
+        bp = coalesce(bp);
+        keep_purged(bp, purged);
+    }
+    else {
+        PUT(HDRP(bp), PACK(csize, 1));
+        PUT(FTRP(bp), PACK(csize, 1));
+        MAP_USE(bp, csize);
+    }
+}
+
+/*
+ * place_high - Like place, but the block goes at the end of free block
+ *      bp and the remainder stays where it is, so if its class doesn't
+ *      change it stays on its list untouched. Returns the block.
+ */
+static inline void *place_high(void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    
+    if (keeps_node(csize, csize - asize)) {
+        PUT(HDRP(bp), PACK(csize-asize, 0));
+        PUT(FTRP(bp), PACK(csize-asize, 0));
+        MAP_UNUSE(bp, csize-asize);
+        stamp_freed(bp);
+        bp = NEXT_BLKP(bp);
+        PUT(HDRP(bp), PACK(asize, 1));
+        PUT(FTRP(bp), PACK(asize, 1));
+        MAP_MARK(bp);
+        MAP_USE(bp, asize);
+        return bp;
+    }
+    
+    remove_free_block(bp);
+    if ((csize - asize) >= MINIMUM) {
+        PUT(HDRP(bp), PACK(csize-asize, 0));
+        PUT(FTRP(bp), PACK(csize-asize, 0));
+        MAP_UNUSE(bp, csize-asize);
+        insert_free_block(bp);
+        bp = NEXT_BLKP(bp);
+        PUT(HDRP(bp), PACK(asize, 1));
+        PUT(FTRP(bp), PACK(asize, 1));
+        MAP_MARK(bp);
+        MAP_USE(bp, asize);
+    }
+    else {
+        PUT(HDRP(bp), PACK(csize, 1));
+        PUT(FTRP(bp), PACK(csize, 1));
+        MAP_USE(bp, csize);
+    }
+    return bp;
+}
+
+static inline void *find_fit(size_t asize)
+{
+
+    /* First fit search */
+    dbg_printf("begin find fit of size %zu\n",asize);
+    void *bp;
+    
+    int cp = find_minimum_class(asize);
+    
+    dbg_printf("minimum class is %d\n",cp);
+    
+    for(; cp <= MAX_CLASS; cp++ )
+    {
+#ifdef MM_FIT_INDEX
+        /* Unless it has overflowed, the index has the whole class */
+        if (cp == MAX_CLASS && fit_overflow == 0)
+            return fit_search(asize);
+#endif
+         bp = get_head_classp(cp);
+        dbg_printf("bp is %p\n",bp);
+         if(bp == NULL)
+         {
+             dbg_printf("head of class %d is NULL\n",cp);
+             continue;
+         }
+        /* A class holds a range of sizes, so check each block fits */
+        for (; bp != NULL; bp = NEXT_FREEP(bp)) {
+            if (asize <= GET_SIZE(HDRP(bp))) {
+            dbg_printf("Found free blobk in class %d \n with pointer %p\n",cp,bp);
+            dbg_printf("end find fit of size %zu\n",asize);
+            return bp;
+            }
+        }
+    }
+    
+    // comment out explicit list version
+    /*
+    for (bp = free_listp; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREEP(bp)) {
+        if (asize <= GET_SIZE(HDRP(bp))) {
+            return bp;
+        }
+    }
+     */
+    dbg_printf("end find fit of size %zu\n",asize);
+    return NULL; /* No fit */
+
+}
+
+/*
+ * calloc - you may want to look at mm-naive.c
+ * This function is not tested by mdriver, but it is
+ * needed to run the traces.
+ */
+void *calloc (size_t nmemb, size_t size) {
+    size_t bytes = nmemb * size;
+    void *newptr;
+    
+    newptr = malloc(bytes);
+    memset(newptr, 0, bytes);
+    
+    return newptr;
+}
+/*
+ * alloc_run - Allocate n neighbouring blocks of asize bytes into out
+ *      from one free block; the last one takes any slack
+ */
+static int alloc_run(size_t asize, size_t n, void **out) {
+    char *bp;
+    size_t i, total = n * asize;
+    
+    bp = find_fit(total);
+#ifdef MM_THREAD_HEAPS
+    if (bp == NULL && remote_drain() > 0)
+        bp = find_fit(total);
+#endif
+#ifdef MM_THREADS
+    if (bp == NULL && depot_drain() > 0)
+        bp = find_fit(total);
+#endif
+    if (bp == NULL &&
+        (bp = extend_heap(MAX(total, CHUNKSIZE)/WSIZE)) == NULL)
+        return 0;
+    place(bp, total);
+    
+    total = GET_SIZE(HDRP(bp));
+    for (i = 0; i < n - 1; i++) {
+        PUT(HDRP(bp), PACK(asize, 1));
+        PUT(FTRP(bp), PACK(asize, 1));
+        MAP_USE(bp, asize);
+        out[i] = bp;
+        bp = NEXT_BLKP(bp);
+        MAP_MARK(bp);
+    }
+    PUT(HDRP(bp), PACK(total - (n-1) * asize, 1));
+    PUT(FTRP(bp), PACK(total - (n-1) * asize, 1));
+    MAP_USE(bp, total - (n-1) * asize);
+    out[i] = bp;
+    
+    dbg_checkheap();
+    return 1;
+}
+
+/*
+ * malloc_batch - Allocate n blocks of size bytes into out, taking the
+ *      lock once and carving them from as few free blocks as it can.
+ *      Returns how many it allocated, which is less than n only when
+ *      memory runs out.
+ */
+size_t malloc_batch(size_t size, size_t n, void **out) {
+    size_t asize, k, done = 0;
+#ifdef MM_THREAD_HEAPS
+    heap_t *h;
+#endif
+    
+    if (size == 0 || n == 0)
+        return 0;
+    asize = MAX(ALIGN(size) + DSIZE, MINIMUM);
+    k = MAX(BATCH_RUN / asize, 1);
+    
+#ifdef MM_THREAD_HEAPS
+    if ((h = heap_get()) == NULL)
+        return 0;
+    heap_lock(h);
+    for (; done < n && alloc_run(asize, MIN(n - done, k), out + done);
+         done += MIN(n - done, k))
+        ;
+    pthread_mutex_unlock(&h->lock);
+    return done;
+#endif
+    
+    LOCK();
+    if (free_listp == 0)
+        init_heap();
+    for (; done < n && alloc_run(asize, MIN(n - done, k), out + done);
+         done += MIN(n - done, k))
+        ;
+    UNLOCK();
+    return done;
+}
+
+/*
+ * malloc_usable_size - Bytes the caller may use at ptr, at least what
+ *      it asked for: the payload of its block, less the footer
+ */
+size_t malloc_usable_size(void *ptr) {
+    if (ptr == NULL)
+        return 0;
+    return GET_SIZE(HDRP(ptr)) - DSIZE;
+}
+
+/*
+ * memalign - malloc whose payload starts at a multiple of alignment,
+ *      which must be a power of two
+ */
+void *memalign(size_t alignment, size_t size) {
+    size_t asize;
+    char *bp;
+#ifdef MM_THREAD_HEAPS
+    heap_t *h;
+#endif
+    
+    if (alignment <= ALIGNMENT)
+        return malloc(size);
+    if ((alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (size == 0)
+        return NULL;
+    
+    asize = MAX(ALIGN(size) + DSIZE, MINIMUM);
+    
+#ifdef MM_THREAD_HEAPS
+    if ((h = heap_get()) == NULL)
+        return NULL;
+    heap_lock(h);
+    bp = alloc_aligned(asize, alignment);
+    pthread_mutex_unlock(&h->lock);
+    return bp;
+#endif
+    
+    LOCK();
+    if (free_listp == 0)
+        init_heap();
+    bp = alloc_aligned(asize, alignment);
+    UNLOCK();
+    return bp;
+}
+
+/*
+ * posix_memalign - memalign, as POSIX spells it
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    void *p;
+    
+    if (alignment % sizeof(void *) != 0 ||
+        (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    if ((p = memalign(alignment, size)) == NULL && size != 0)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+/*
+ * aligned_alloc - memalign, as C11 spells it
+ */
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+/*
+ * A region bump-allocates from a list of chunks it mallocs, and frees
+ * nothing until reset, which rewinds it to the first chunk (keeping the
+ * ones it used for reuse, and freeing the rest), or destroy, which hands
+ * every chunk back.
+ */
+typedef struct region_chunk {
+    struct region_chunk *next;
+    size_t size;                /* bytes after this header */
+} region_chunk_t;
+
+struct mm_region {
+    region_chunk_t *first;      /* chunks in the order they're used */
+    region_chunk_t *chunk;      /* the one being carved */
+    char *cur;                  /* next free byte of chunk ... */
+    char *end;                  /* ... and its end */
+    size_t chunk_size;          /* 0 to size chunks by the requests */
+};
+
+#define CHUNK_START(c)  ((char *)(c) + sizeof(region_chunk_t))
+
+/*
+ * mm_region_create - A region whose chunks are chunk_size bytes, or for
+ *      0, start at REGION_FIRST times the first request and double up to
+ *      REGION_CHUNK; bigger requests get a chunk of their own
+ */
+mm_region_t *mm_region_create(size_t chunk_size) {
+    mm_region_t *r;
+    
+    if ((r = malloc(sizeof(mm_region_t))) == NULL)
+        return NULL;
+    r->first = r->chunk = NULL;
+    r->cur = r->end = NULL;
+    r->chunk_size = ALIGN(chunk_size);
+    return r;
+}
+
+/*
+ * mm_region_alloc - Bump-allocate size bytes from r, moving on to the
+ *      next chunk that fits (or a new one) when this one is full
+ */
+void *mm_region_alloc(mm_region_t *r, size_t size) {
+    region_chunk_t *c, *prev = r->chunk;
+    char *p;
     
-	/* Copy the old data. */
-	if(size < oldsize) oldsize = size;
-	memcpy(newptr, oldptr, oldsize);
+    size = ALIGN(size);
+    if (size == 0)
+        return NULL;
+    if (size > (size_t)(r->end - r->cur)) {
+        c = (prev != NULL) ? prev->next : r->first;
+        if (c == NULL || c->size < size) {
+            size_t csize = r->chunk_size;
+            
+            if (csize == 0 && prev != NULL)
+                csize = MIN(2 * prev->size, REGION_CHUNK);
+            else if (csize == 0)
+                csize = MIN(MAX(REGION_FIRST * size, REGION_MIN), REGION_CHUNK);
+            csize = MAX(size, csize);
+            
+            if ((c = malloc(sizeof(region_chunk_t) + csize)) == NULL)
+                return NULL;
+            c->size = csize;
+            if (prev != NULL) {
+                c->next = prev->next;
+                prev->next = c;
+            }
+            else {
+                c->next = r->first;
+                r->first = c;
+            }
+        }
+        r->chunk = c;
+        r->cur = CHUNK_START(c);
+        r->end = r->cur + c->size;
+    }
+    p = r->cur;
+    r->cur += size;
+    return p;
+}
+
+/*
+ * mm_region_reset - Free everything allocated from r at once. Chunks
+ *      past the one in use weren't needed this time, so they go back to
+ *      the heap rather than sit idle until the region next grows that far.
+ */
+void mm_region_reset(mm_region_t *r) {
+    region_chunk_t *c, *next;
     
-	/* Free the old block. */
-	free(oldptr);
+    if (r->chunk != NULL) {
+        for (c = r->chunk->next; c != NULL; c = next) {
+            next = c->next;
+            free(c);
+        }
+        r->chunk->next = NULL;
+    }
+    r->chunk = NULL;
+    r->cur = r->end = NULL;
+}
 
-    //mm_checkheap(1);
-    return newptr;
+/*
+ * mm_region_destroy - Reset r and give its chunks back to the heap
+ */
+void mm_region_destroy(mm_region_t *r) {
+    region_chunk_t *c, *next;
+    
+    if (r == NULL)
+        return;
+    for (c = r->first; c != NULL; c = next) {
+        next = c->next;
+        free(c);
+    }
+    free(r);
 }
 
+/*
+ * A pool hands out objects of one size from slabs, aligned blocks of
+ * slab_size bytes (a power of two) that it memaligns, so the slab of an
+ * object is found by masking its address. A slab keeps its free objects
+ * on a list threaded through them, and carves objects it has never
+ * handed out from its end lazily. Every slab is on the pool's partial or
+ * full list, except one empty slab the pool keeps back so that a get
+ * and put loop doesn't memalign and free a slab each time round. Pools
+ * aren't thread-safe.
+ */
+typedef struct slab {
+    struct slab *prev, *next;   /* the pool's partial or full slabs */
+    mm_pool_t *pool;
+    char *free;                 /* list of put objects */
+    char *fresh;                /* first object never handed out */
+    int used;                   /* objects handed out */
+} slab_t;
+
+struct mm_pool {
+    slab_t *partial;            /* slabs with a free object */
+    slab_t *full;               /* slabs with none */
+    slab_t *empty;              /* an emptied slab kept for reuse, or NULL */
+    size_t obj_size;
+    size_t slab_size;
+    size_t first;               /* offset of a slab's first object */
+    int nobjs;                  /* objects per slab */
+};
 
+#define SLAB_OF(p, pool)  ((slab_t *)((size_t)(p) & ~((pool)->slab_size - 1)))
 
 /*
- * extend_heap - Extend heap with free block and return its block pointer
+ * slab_push - Put slab s at the head of list
  */
-static inline void *extend_heap(size_t words)
-{
-    char *bp;
-    size_t size;
+static inline void slab_push(slab_t **list, slab_t *s) {
+    s->prev = NULL;
+    s->next = *list;
+    if (s->next != NULL)
+        s->next->prev = s;
+    *list = s;
+}
+
+/*
+ * slab_unlink - Take slab s off list
+ */
+static inline void slab_unlink(slab_t **list, slab_t *s) {
+    if (s->prev != NULL)
+        s->prev->next = s->next;
+    else
+        *list = s->next;
+    if (s->next != NULL)
+        s->next->prev = s->prev;
+}
+
+/*
+ * mm_pool_create - A pool of objects of obj_size bytes at a multiple of
+ *      align (a power of two; 0 for the usual ALIGNMENT)
+ */
+mm_pool_t *mm_pool_create(size_t obj_size, size_t align) {
+    mm_pool_t *pool;
     
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE; 
+    if (align < ALIGNMENT)
+        align = ALIGNMENT;
+    if (obj_size == 0 || (align & (align - 1)) != 0)
+        return NULL;
+    if ((pool = malloc(sizeof(mm_pool_t))) == NULL)
+        return NULL;
     
-    if(size < MINIMUM)
-        size = MINIMUM;
+    pool->partial = pool->full = pool->empty = NULL;
+    pool->obj_size = (obj_size + align - 1) & ~(align - 1);
+    pool->first = (sizeof(slab_t) + align - 1) & ~(align - 1);
+    pool->slab_size = CHUNKSIZE;
+    while (pool->slab_size - DSIZE < pool->first + SLAB_OBJS * pool->obj_size)
+        pool->slab_size <<= 1;
+    pool->nobjs = (pool->slab_size - DSIZE - pool->first) / pool->obj_size;
+    return pool;
+}
+
+/*
+ * mm_pool_get - An object from the first slab with a free one, or from
+ *      the kept empty slab, or from a new slab
+ */
+void *mm_pool_get(mm_pool_t *pool) {
+    slab_t *s = pool->partial;
+    char *p;
+    
+    if (s == NULL) {
+        if ((s = pool->empty) != NULL)
+            pool->empty = NULL;
+        /* Leave room after the slab for the block's footer */
+        else if ((s = memalign(pool->slab_size,
+                               pool->slab_size - DSIZE)) == NULL)
+            return NULL;
+        s->pool = pool;
+        s->free = NULL;
+        s->fresh = (char *)s + pool->first;
+        s->used = 0;
+        slab_push(&pool->partial, s);
+    }
     
-    if ((long)(bp = mem_sbrk(size)) == -1)
-        return NULL;
+    if (s->free != NULL) {
+        p = s->free;
+        s->free = *(char **)p;
+    }
+    else {
+        p = s->fresh;
+        s->fresh += pool->obj_size;
+    }
     
-    dbg_printf("extend_heap of size %zu\n",size);
+    if (++s->used == pool->nobjs) {
+        slab_unlink(&pool->partial, s);
+        slab_push(&pool->full, s);
+    }
+    return p;
+}
+
+/*
+ * mm_pool_put - Give obj back to its slab. An emptied slab is kept back
+ *      if the pool has no empty slab yet, and goes to the heap otherwise.
+ */
+void mm_pool_put(mm_pool_t *pool, void *obj) {
+    slab_t *s = SLAB_OF(obj, pool);
     
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* Free block header */   
-    PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */   
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */ 
+    if (s->used-- == pool->nobjs) {
+        slab_unlink(&pool->full, s);
+        slab_push(&pool->partial, s);
+    }
+    if (s->used == 0) {
+        slab_unlink(&pool->partial, s);
+        if (pool->empty == NULL)
+            pool->empty = s;
+        else
+            free(s);
+        return;
+    }
+    *(char **)obj = s->free;
+    s->free = obj;
+}
+
+/*
+ * mm_pool_destroy - Give back every slab of pool, and pool. Objects
+ *      still out must not be used afterwards.
+ */
+void mm_pool_destroy(mm_pool_t *pool) {
+    slab_t *s, *next;
     
-    check_heap(1);
-    /* Coalesce if the previous block was free */
-    return coalesce(bp);                                         
+    if (pool == NULL)
+        return;
+    for (s = pool->partial; s != NULL; s = next) {
+        next = s->next;
+        free(s);
+    }
+    for (s = pool->full; s != NULL; s = next) {
+        next = s->next;
+        free(s);
+    }
+    free(pool->empty);
+    free(pool);
 }
 
+#ifdef MM_FIT_INDEX
 /*
- * Place block of asize bytes at start of free block bp
- * Then split if remainder is at least a minimum block size
+ * fit_add - Give free block bp, joining the largest class, a slot
  */
+static inline void fit_add(void *bp)
+{
+    if (fit_count == FIT_SLOTS) {
+        FIT_SLOT(bp) = FIT_NONE;
+        fit_overflow++;
+        return;
+    }
+    fit_size[fit_count] = GET_SIZE(HDRP(bp));
+    fit_offset[fit_count] = (char *)bp - (char *)mem_heap_lo();
+    FIT_SLOT(bp) = fit_count++;
+}
 
-static inline void place(void *bp, size_t asize)
+/*
+ * fit_remove - Free the slot of free block bp, moving the last slot
+ *      into it
+ */
+static inline void fit_remove(void *bp)
 {
-    size_t csize = GET_SIZE(HDRP(bp));
-    dbg_printf("begin place at %p, size %zu\n",bp,asize);
-    if ((csize - asize) >= MINIMUM) {
-        PUT(HDRP(bp), PACK(asize, 1));
-        PUT(FTRP(bp), PACK(asize, 1));
-        
-        remove_free_block(bp);
-        
-        
-        bp = NEXT_BLKP(bp);
-        dbg_printf("\n\n begin split block at %p, size %zu\n",bp,asize);
-        
-        PUT(HDRP(bp), PACK(csize-asize, 0));
-        PUT(FTRP(bp), PACK(csize-asize, 0));
-        coalesce(bp);
+    unsigned int i = FIT_SLOT(bp);
+    
+    if (i == FIT_NONE) {
+        fit_overflow--;
+        return;
     }
-    else {
-        PUT(HDRP(bp), PACK(csize, 1));
-        PUT(FTRP(bp), PACK(csize, 1));
-        
-        remove_free_block(bp);
+    if (i != --fit_count) {
+        fit_size[i] = fit_size[fit_count];
+        fit_offset[i] = fit_offset[fit_count];
+        FIT_SLOT(FIT_PTR(i)) = i;
     }
 }
 
-static inline void *find_fit(size_t asize)
+/*
+ * fit_scan_* - Highest slot whose block has at least asize bytes, or
+ *      -1. Slots are filled in the order blocks are freed, so scanning
+ *      down from the top looks at recently freed blocks first, as a
+ *      walk of the LIFO list would. The sizes are compared as signed
+ *      ints, which they fit in.
+ */
+#ifdef __x86_64__
+static int fit_scan_sse2(unsigned int asize)
 {
+    __m128i want = _mm_set1_epi32((int)asize - 1);
+    int i, mask;
+    
+    for (i = (int)fit_count - 1; i >= 0 && (i & 3) != 3; i--)
+        if (fit_size[i] >= asize)
+            return i;
+    for (i -= 3; i >= 0; i -= 4) {
+        mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(
+            _mm_load_si128((__m128i *)&fit_size[i]), want)));
+        if (mask)
+            return i + 31 - __builtin_clz(mask);
+    }
+    return -1;
+}
 
-    /* First fit search */
-    dbg_printf("begin find fit of size %zu\n",asize);
-    void *bp;
+__attribute__((target("avx2")))
+static int fit_scan_avx2(unsigned int asize)
+{
+    __m256i want = _mm256_set1_epi32((int)asize - 1);
+    __m256i lo, hi;
+    int i, mask;
+    
+    for (i = (int)fit_count - 1; i >= 0 && (i & 15) != 15; i--)
+        if (fit_size[i] >= asize)
+            return i;
+    /* Sixteen sizes at a time, as two compares whose masks are joined */
+    for (i -= 15; i >= 0; i -= 16) {
+        lo = _mm256_cmpgt_epi32(_mm256_load_si256((__m256i *)&fit_size[i]), want);
+        hi = _mm256_cmpgt_epi32(_mm256_load_si256((__m256i *)&fit_size[i+8]), want);
+        mask = _mm256_movemask_ps(_mm256_castsi256_ps(lo)) |
+            _mm256_movemask_ps(_mm256_castsi256_ps(hi)) << 8;
+        if (mask)
+            return i + 31 - __builtin_clz(mask);
+    }
+    return -1;
+}
+#else
+static int fit_scan_scalar(unsigned int asize)
+{
+    int i;
     
-    int cp = find_minimum_class(asize);
+    for (i = (int)fit_count - 1; i >= 0; i--)
+        if (fit_size[i] >= asize)
+            return i;
+    return -1;
+}
+#endif
+
+/*
+ * fit_scan_best - The fastest fit_scan_* this CPU can run
+ */
+static int (*fit_scan_best(void))(unsigned int)
+{
+#ifdef __x86_64__
+    if (__builtin_cpu_supports("avx2"))
+        return fit_scan_avx2;
+    return fit_scan_sse2;
+#else
+    return fit_scan_scalar;
+#endif
+}
+
+/*
+ * fit_search - First fit in the largest class through the index; only
+ *      the block found is touched
+ */
+static inline void *fit_search(size_t asize)
+{
+    int i = fit_scan(asize);
     
-    dbg_printf("minimum class is %d\n",cp);
+    return (i < 0) ? NULL : FIT_PTR(i);
+}
+#endif
+
+#ifdef MM_ADDR_ORDER
+/*
+ * skip_level - Highest skip list level of free block bp, from a hash
+ *      of its address (so a quarter of the blocks on each level are on
+ *      the next) and no more than it has room for; its size must not
+ *      change while it is on a list
+ */
+static inline int skip_level(void *bp)
+{
+    uint32_t h = (uint32_t)(((uintptr_t)bp >> 3) * 0x9e3779b97f4a7c15ULL >> 32);
+    int level = __builtin_ctz(h | 1u << (2*SKIP_LEVELS)) / 2;
     
-    for(; cp <= MAX_CLASS; cp++ )
-    {
-         bp = get_head_classp(cp);
-        printf("bp is %p\n",bp);
-         if(bp == NULL)
-         {
-             dbg_printf("head of class %d is NULL\n",cp);
-             continue;
-         }
-        for (; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREEP(bp)) {
-            //if (asize <= GET_SIZE(HDRP(bp))) {
-            
-            current_class = cp;
-            dbg_printf("Found free blobk in class %d \n with pointer %p\n",cp,bp);
-            dbg_printf("end find fit of size %zu\n",asize);
-            return bp;
-            //}
+    return MIN(level, (int)(GET_SIZE(HDRP(bp)) - MINIMUM) / DSIZE);
+}
+
+/*
+ * skip_search - Set update[k], for each level k from 1 to SKIP_LEVELS,
+ *      to the level-k link (a head or a forward pointer) that bp goes
+ *      after in the skip list; returns the block that link is in on
+ *      level 1, or NULL if it is the head
+ */
+static inline char *skip_search(void *bp, char **update[])
+{
+    char **link;
+    char *pred = NULL;
+    int k;
+    
+    for (k = SKIP_LEVELS; k >= 1; k--) {
+        link = pred ? &SKIP_NEXT(pred, k) : &skip_head[k];
+        while (*link != NULL && *link < (char *)bp) {
+            pred = *link;
+            link = &SKIP_NEXT(pred, k);
         }
+        update[k] = link;
     }
-    
-    // comment out explicit list version
-    /*
-    for (bp = free_listp; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREEP(bp)) {
-        if (asize <= GET_SIZE(HDRP(bp))) {
-            return bp;
+    return pred;
+}
+
+/*
+ * insert_ordered - Link free block bp into the list of class in address
+ *      order: the skip list gets within a few blocks of its place in
+ *      O(log n), and the class list is walked from there. The smaller
+ *      classes, whose blocks have little or no room for skip pointers
+ *      and differ in size by DSIZE at most, stay LIFO.
+ */
+static inline void insert_ordered(void *bp, int class)
+{
+    char **update[SKIP_LEVELS+1];
+    char *prev = NULL, *next = get_head_classp(class);
+    int k, level = 0;
+    
+    if (class == MAX_CLASS) {
+        prev = skip_search(bp, update);
+        if (prev)
+            next = NEXT_FREEP(prev);
+        while (next != NULL && next < (char *)bp) {
+            prev = next;
+            next = NEXT_FREEP(next);
         }
+        level = skip_level(bp);
+    }
+    PREV_FREEP(bp) = prev;
+    NEXT_FREEP(bp) = next;
+    if (prev)
+        NEXT_FREEP(prev) = bp;
+    else
+        SET_HEAD_CLASSP(bp, class);
+    if (next)
+        PREV_FREEP(next) = bp;
+    
+    for (k = 1; k <= level; k++) {
+        SKIP_NEXT(bp, k) = *update[k];
+        *update[k] = bp;
     }
-     */
-    current_class = 0;
-    dbg_printf("end find fit of size %zu\n",asize);
-    return NULL; /* No fit */
-
 }
 
 /*
- * calloc - you may want to look at mm-naive.c
- * This function is not tested by mdriver, but it is
- * needed to run the traces.
+ * skip_unlink - Take free block bp, on the list of class, off the levels
+ *      of the skip list above that list
  */
-void *calloc (size_t nmemb, size_t size) {
-    size_t bytes = nmemb * size;
-    void *newptr;
-    
-    newptr = malloc(bytes);
-    memset(newptr, 0, bytes);
+static inline void skip_unlink(void *bp, int class)
+{
+    char **update[SKIP_LEVELS+1];
+    int k, level = skip_level(bp);
     
-    return newptr;
+    if (class != MAX_CLASS || level == 0)
+        return;
+    skip_search(bp, update);
+    for (k = 1; k <= level; k++)
+        *update[k] = SKIP_NEXT(bp, k);
 }
+#endif
+
 /*
  * Remove free block pointed by bp
  */
 
 static inline void remove_free_block(void *bp)
 {
+    int class = find_minimum_class(GET_SIZE(HDRP(bp)));
+    
     dbg_printf("Begin remove free block at %p\n",bp);
     /* If there's a previous block, set its next pointer to the next block.
-	 * Otherwise, set this block to be the beginning of free list.
+	 * Otherwise, set the next block to be the head of the class.
      */
 	if (PREV_FREEP(bp))
     {
         dbg_printf("bp have previous pointer\n");
 		NEXT_FREEP(PREV_FREEP(bp)) = NEXT_FREEP(bp);
-        PREV_FREEP(NEXT_FREEP(bp)) = PREV_FREEP(bp);
 	}
     else
     {
-		//free_listp = NEXT_FREEP(bp);
-        //HEAD_CLASSP(current_class) = NEXT_FREEP(bp);
         dbg_printf("bp have no previous pointer set new head\n");
-        SET_HEAD_CLASSP(NEXT_FREEP(bp),current_class);
+        SET_HEAD_CLASSP(NEXT_FREEP(bp),class);
 	}
-    check_heap(1);
+    if (NEXT_FREEP(bp))
+        PREV_FREEP(NEXT_FREEP(bp)) = PREV_FREEP(bp);
+#ifdef MM_ADDR_ORDER
+    skip_unlink(bp, class);
+#endif
+#ifdef MM_FIT_INDEX
+    if (class == MAX_CLASS)
+        fit_remove(bp);
+#endif
+    dbg_checkheap();
     
 }
 
@@ -559,11 +2807,17 @@ static inline void insert_free_block(void *bp)
     //head1 = *(char **)(heap_listp + WSIZE*(class-1));
     //*(char **)(heap_listp + WSIZE*(class-1))
     
-    void *head = get_head_classp(current_class);
+    int class = find_minimum_class(GET_SIZE(HDRP(bp)));
+#ifdef MM_ADDR_ORDER
+    dbg_checkheap();
+    insert_ordered(bp, class);
+#else
+    void *head = get_head_classp(class);
     
     
-    check_heap(1);
+    dbg_checkheap();
     
+    NEXT_FREEP(bp) = head; //Sets next ptr to start of free list (NULL if empty)
     if(head == NULL)
     {
         dbg_printf("this class has no head yet, make bp the head of the class\n");
@@ -571,16 +2825,21 @@ static inline void insert_free_block(void *bp)
     }
     else
     {
-        dbg_printf("head of class %d is %p \n",current_class,head);
-        NEXT_FREEP(bp) = head; //Sets next ptr to start of free list
+        dbg_printf("head of class %d is %p \n",class,head);
         PREV_FREEP(head) = bp; //Sets previous pointer of current head to new block
     }
         
     
 	PREV_FREEP(bp) = NULL; // Sets previous pointer to NULL
-    SET_HEAD_CLASSP(bp,current_class); // Sets new block to be start of free list
+    SET_HEAD_CLASSP(bp,class); // Sets new block to be start of free list
+#endif
+#ifdef MM_FIT_INDEX
+    if (class == MAX_CLASS)
+        fit_add(bp);
+#endif
+    stamp_freed(bp);
     
-    mm_checkheap(1);
+    dbg_checkheap();
     
     dbg_printf("finish insert free block :%p \n",bp);
 }
@@ -637,13 +2896,15 @@ static int aligned(const void *p) {
 static void print_block(void *bp)
 {
     int hsize, halloc, fsize, falloc;
+#ifdef DEBUG
     int i;
+    int *p = (int *)bp;
+#endif
     //checkheap(0);
     hsize = GET_SIZE(HDRP(bp));
     halloc = GET_ALLOC(HDRP(bp));
     fsize = GET_SIZE(FTRP(bp));
     falloc = GET_ALLOC(FTRP(bp));
-    int *p = (int *)bp;
     if (hsize == 0) {
         printf("%p: EOL\n", bp);
         return;
@@ -655,11 +2916,13 @@ static void print_block(void *bp)
         hsize, (halloc ? 'a' : 'f'),
         fsize, (falloc ? 'a' : 'f'));
         
+#ifdef DEBUG
         dbg_printf("block content :\n");
-        for (i = 0; i < hsize; ++i)
+        for (i = 0; i < hsize/WSIZE; ++i)
         {
             dbg_printf("%p:%#x ", p+i,p[i]);
         }
+#endif
     }
     else{
         printf("%p: header: [%d:%c] prev:%p next:%p footer: [%d:%c]\n", bp,
@@ -673,8 +2936,7 @@ static void print_block(void *bp)
 static void check_block(void *bp)
 {
     int halloc = GET_ALLOC(HDRP(bp));    
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))) || PREV_BLKP(bp) == bp; //possible to remove second clause
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t prev_alloc, next_alloc;
     
     if (!in_heap(bp))
         printf("Error: %p is not in heap\n", bp);
@@ -688,6 +2950,9 @@ static void check_block(void *bp)
     */
     if (!halloc)
     {
+        /* Free blocks always follow the prologue or a fence block */
+        prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+        next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
         if (!prev_alloc) {
             printf("Error: %p previous block is free, should coalescing\n", bp);
         }
@@ -706,28 +2971,82 @@ static void check_block(void *bp)
  */
 void check_heap(int verbose)
 {
-    char *bp;
+    char *c, *bp;
+#ifdef MM_ADDR_ORDER
+    int k;
+#endif
+#ifdef MM_FIT_INDEX
+    unsigned int i, n = 0;
+#endif
     
     dbg_printf("Begin check entire heap\n");
     
-    if (verbose)
-        printf("Heap (%p):\n", heap_listp);
-    
-    if ((GET_SIZE(HDRP(heap_listp)) != MINIMUM) || !GET_ALLOC(HDRP(heap_listp)))
-        printf("Bad prologue header\n");
-    check_block(heap_listp);
-
-    
-    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
-        if(verbose)
+    for (c = FIRST_CHUNK(); c != NULL; c = NEXT_CHUNK(c)) {
+        bp = c + DSIZE;
+        if (verbose)
+            printf("Heap (%p):\n", bp);
+        
+        /* The prologue, or in a later chunk a fence block */
+        if ((GET_SIZE(HDRP(bp)) != MINIMUM && GET_SIZE(HDRP(bp)) != DSIZE) ||
+            !GET_ALLOC(HDRP(bp)))
+            printf("Bad prologue header\n");
+        
+        for (; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+            if(verbose)
+                print_block(bp);
+            check_block(bp);
+#ifdef MM_BITMAP
+            if (!MAP_TEST(map_start, GRANULE(bp)) ||
+                map_next(map_start, GRANULE(bp) + 1) != GRANULE(NEXT_BLKP(bp)) ||
+                MAP_TEST(map_alloc, GRANULE(bp)) != GET_ALLOC(HDRP(bp)) ||
+                MAP_TEST(map_alloc, GRANULE(NEXT_BLKP(bp)) - 1) != GET_ALLOC(HDRP(bp)))
+                printf("Error: bitmaps disagree with the tags of %p\n", bp);
+#endif
+        }
+        
+        if (verbose)
             print_block(bp);
-        check_block(bp);
+        if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
+            printf("Bad epilogue header\n");
+#ifdef MM_BITMAP
+        if (!MAP_TEST(map_start, GRANULE(bp)) || !MAP_TEST(map_alloc, GRANULE(bp)))
+            printf("Error: bitmaps miss the epilogue\n");
+        if (GRANULE(bp) / 64 >= map_used)
+            printf("Error: map_used stops short of the epilogue\n");
+#endif
+#ifdef MM_THREAD_HEAPS
+        if (bp != c + GET(c))
+            printf("Error: chunk %p ends at %p, not %p\n", c, bp, c + GET(c));
+        if (PAGE_INDEX(c) >= MAX_PAGES || page_owner[PAGE_INDEX(c)] == 0)
+            printf("Error: chunk %p has no owner\n", c);
+#endif
     }
-    
-    if (verbose)
-        print_block(bp);
-    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
-        printf("Bad epilogue header\n");
+#ifdef MM_ADDR_ORDER
+    /* Every level of the largest class's list is in address order */
+    for (bp = get_head_classp(MAX_CLASS); bp != NULL; bp = NEXT_FREEP(bp))
+        if (NEXT_FREEP(bp) != NULL && NEXT_FREEP(bp) <= bp)
+            printf("Error: free list out of order at %p\n", bp);
+    for (k = 1; k <= SKIP_LEVELS; k++)
+        for (bp = skip_head[k]; bp != NULL; bp = SKIP_NEXT(bp, k))
+            if (skip_level(bp) < k ||
+                (SKIP_NEXT(bp, k) != NULL && SKIP_NEXT(bp, k) <= bp))
+                printf("Error: skip list level %d bad at %p\n", k, bp);
+#endif
+#ifdef MM_FIT_INDEX
+    /* Each slot names a free block that names it back, and every block
+       of the largest class has a slot or is counted as overflow */
+    for (i = 0; i < fit_count; i++) {
+        bp = FIT_PTR(i);
+        if (GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) != fit_size[i] ||
+            FIT_SLOT(bp) != i)
+            printf("Error: fit index slot %u bad at %p\n", i, bp);
+    }
+    for (bp = get_head_classp(MAX_CLASS); bp != NULL; bp = NEXT_FREEP(bp))
+        n++;
+    if (n != fit_count + fit_overflow)
+        printf("Error: %u blocks in the largest class, %u in the fit index\n",
+               n, fit_count + fit_overflow);
+#endif
    /*
     dbg_printf("End check entire heap\n");
     
@@ -749,5 +3068,75 @@ void check_heap(int verbose)
  * mm_checkheap
  */
 void mm_checkheap(int verbose) {
+    LOCK();
     check_heap(verbose);
+    UNLOCK();
+}
+
+/*
+ * count_free - Add free block bp, of size bytes, to stats
+ */
+static void count_free(mm_heapstats_t *stats, char *bp, size_t size)
+{
+    char *hi;
+    size_t pages;
+    
+    stats->free_bytes += size;
+    stats->largest_free = MAX(stats->largest_free, size);
+    pages = page_span(bp, &hi);
+#ifdef MM_THREADS
+    if (size >= PURGE_MIN) {
+        stats->purged_bytes += PURGED(bp) * CHUNKSIZE;
+        pages -= PURGED(bp);
+    }
+#endif
+    stats->dirty_bytes += pages * CHUNKSIZE;
+}
+
+/*
+ * mm_heapstats - walk the heap and total up free and allocated blocks,
+ * not counting the prologue and epilogue (or fence blocks). With
+ * MM_THREAD_HEAPS, no other thread may be using the heap meanwhile.
+ * With MM_BITMAP the walk is over the bitmaps, and only free blocks
+ * are touched (for page_span and their purge records).
+ */
+void mm_heapstats(mm_heapstats_t *stats)
+{
+#ifdef MM_BITMAP
+    size_t g, next, end;
+#else
+    char *c, *bp;
+#endif
+    size_t size;
+
+    stats->free_bytes = 0;
+    stats->largest_free = 0;
+    stats->alloc_bytes = 0;
+    stats->dirty_bytes = 0;
+    stats->purged_bytes = 0;
+
+    LOCK();
+#ifdef MM_BITMAP
+    /* A block runs from its start bit up to the next one */
+    end = GRANULE((char *)mem_heap_hi() + 1);        /* The epilogue */
+    for (g = GRANULE(NEXT_BLKP(heap_listp)); g < end; g = next) {
+        next = map_next(map_start, g + 1);
+        size = (next - g) * DSIZE;
+        if (MAP_TEST(map_alloc, g))
+            stats->alloc_bytes += size;
+        else
+            count_free(stats, (char *)mem_heap_lo() + g*DSIZE, size);
+    }
+#else
+    for (c = FIRST_CHUNK(); c != NULL; c = NEXT_CHUNK(c)) {
+        for (bp = NEXT_BLKP(c + DSIZE); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+            size = GET_SIZE(HDRP(bp));
+            if (GET_ALLOC(HDRP(bp)))
+                stats->alloc_bytes += size;
+            else
+                count_free(stats, bp, size);
+        }
+    }
+#endif
+    UNLOCK();
 }
@@ -1,5 +1,40 @@
+#ifndef __MM_H_
+#define __MM_H_
+
 #include <stdio.h>
 
+/* Allocators other than mm.c are compiled with -DMM_PREFIX=<name>_ so
+   that mdriver can link several of them side by side (see backend.c) */
+#ifdef MM_PREFIX
+#define MM_CAT2(a, b) a##b
+#define MM_CAT(a, b) MM_CAT2(a, b)
+#define mm_init      MM_CAT(MM_PREFIX, mm_init)
+#define mm_malloc    MM_CAT(MM_PREFIX, mm_malloc)
+#define mm_free      MM_CAT(MM_PREFIX, mm_free)
+#define mm_realloc   MM_CAT(MM_PREFIX, mm_realloc)
+#define mm_calloc    MM_CAT(MM_PREFIX, mm_calloc)
+#define mm_memalign  MM_CAT(MM_PREFIX, mm_memalign)
+#define mm_posix_memalign MM_CAT(MM_PREFIX, mm_posix_memalign)
+#define mm_aligned_alloc  MM_CAT(MM_PREFIX, mm_aligned_alloc)
+#define mm_usable_size    MM_CAT(MM_PREFIX, mm_usable_size)
+#define mm_free_sized     MM_CAT(MM_PREFIX, mm_free_sized)
+#define mm_malloc_batch   MM_CAT(MM_PREFIX, mm_malloc_batch)
+#define mm_free_batch     MM_CAT(MM_PREFIX, mm_free_batch)
+#define mm_region_create  MM_CAT(MM_PREFIX, mm_region_create)
+#define mm_region_alloc   MM_CAT(MM_PREFIX, mm_region_alloc)
+#define mm_region_reset   MM_CAT(MM_PREFIX, mm_region_reset)
+#define mm_region_destroy MM_CAT(MM_PREFIX, mm_region_destroy)
+#define mm_pool_create    MM_CAT(MM_PREFIX, mm_pool_create)
+#define mm_pool_get       MM_CAT(MM_PREFIX, mm_pool_get)
+#define mm_pool_put       MM_CAT(MM_PREFIX, mm_pool_put)
+#define mm_pool_destroy   MM_CAT(MM_PREFIX, mm_pool_destroy)
+#define mm_malloc_hint    MM_CAT(MM_PREFIX, mm_malloc_hint)
+#define mm_checkheap MM_CAT(MM_PREFIX, mm_checkheap)
+#define mm_heapstats MM_CAT(MM_PREFIX, mm_heapstats)
+#define mm_purge_start MM_CAT(MM_PREFIX, mm_purge_start)
+#define mm_purge_stop  MM_CAT(MM_PREFIX, mm_purge_stop)
+#endif
+
 #ifdef DRIVER
 
 /* declare functions for driver tests */
@@ -7,6 +42,13 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+extern size_t mm_usable_size(void *ptr);
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
 
 #else
 
@@ -15,6 +57,13 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t alignment, size_t size);
+extern int posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *aligned_alloc(size_t alignment, size_t size);
+extern size_t malloc_usable_size(void *ptr);
+extern void free_sized(void *ptr, size_t size);
+extern size_t malloc_batch(size_t size, size_t n, void **out);
+extern void free_batch(void **ptrs, size_t n);
 
 #endif
 
@@ -23,3 +72,50 @@ extern int mm_init(void);
 /* This is largely for debugging.  You can do what you want with the
    verbose flag; we don't care. */
 extern void mm_checkheap(int verbose);
+
+/* Snapshot of how the heap is carved up, used by the driver to sample
+   fragmentation over the course of a trace. Sizes include the block
+   header and footer. */
+typedef struct {
+    size_t free_bytes;    /* total size of all free blocks */
+    size_t largest_free;  /* size of the largest free block */
+    size_t alloc_bytes;   /* total size of all allocated blocks */
+    size_t dirty_bytes;   /* whole pages of free blocks not known to be purged */
+    size_t purged_bytes;  /* whole pages of free blocks given back to the OS */
+} mm_heapstats_t;
+
+extern void mm_heapstats(mm_heapstats_t *stats);
+
+/* How long a block from mm_malloc_hint is expected to live */
+#define MM_HINT_UNKNOWN 0
+#define MM_HINT_SHORT   1
+#define MM_HINT_LONG    2
+
+extern void *mm_malloc_hint(size_t size, int hint);
+
+/* Regions: objects bump-allocated from big blocks of the heap that are
+   all freed together by mm_region_reset, rather than one at a time */
+typedef struct mm_region mm_region_t;
+
+extern mm_region_t *mm_region_create(size_t chunk_size);
+extern void *mm_region_alloc(mm_region_t *r, size_t size);
+extern void mm_region_reset(mm_region_t *r);
+extern void mm_region_destroy(mm_region_t *r);
+
+/* Pools: objects of one size kept on free lists inside slabs taken
+   from the heap, with no header or footer of their own */
+typedef struct mm_pool mm_pool_t;
+
+extern mm_pool_t *mm_pool_create(size_t obj_size, size_t align);
+extern void *mm_pool_get(mm_pool_t *pool);
+extern void mm_pool_put(mm_pool_t *pool, void *obj);
+extern void mm_pool_destroy(mm_pool_t *pool);
+
+/* Only in builds of mm.c with -DMM_THREADS: a background thread that
+   gives the pages of free blocks back to the OS (madvise) over decay_ms
+   milliseconds after they were freed, with MADV_FREE if lazy is set and
+   MADV_DONTNEED otherwise. Returns -1 if the thread can't be started. */
+extern int mm_purge_start(int decay_ms, int lazy);
+extern void mm_purge_stop(void);
+
+#endif /* __MM_H_ */
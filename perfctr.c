@@ -0,0 +1,162 @@
+/*
+ * perfctr.c - hardware event counters using perf_event_open
+ *
+ * Each event gets its own counter rather than one group, so an event
+ * the CPU (or hypervisor) doesn't support doesn't take the others down
+ * with it. If the kernel has to multiplex the counters, the counts are
+ * scaled by the fraction of the run each one was actually counting.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "perfctr.h"
+
+const char *perfctr_names[PERFCTR_NEVENTS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses",
+    "dtlb_misses", "branch_misses"
+};
+
+static int fds[PERFCTR_NEVENTS] = { -1, -1, -1, -1, -1, -1 };
+static double totals[PERFCTR_NEVENTS];
+static int runs = 0;
+
+#ifdef __linux__
+
+/* Encode a cache read-miss event */
+#define CACHE_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+    unsigned type;
+    unsigned long long config;
+} events[PERFCTR_NEVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+/* What read() returns with the read_format we ask for */
+struct reading {
+    unsigned long long value;
+    unsigned long long time_enabled;
+    unsigned long long time_running;
+};
+
+/*
+ * perfctr_init - open a disabled user-space counter for each event
+ */
+int perfctr_init(void)
+{
+    struct perf_event_attr attr;
+    int i, n = 0;
+
+    for (i = 0; i < PERFCTR_NEVENTS; i++) {
+	if (fds[i] >= 0) {
+	    n++;
+	    continue;
+	}
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fds[i] >= 0)
+	    n++;
+    }
+    return n;
+}
+
+/*
+ * perfctr_start - zero and enable every open counter
+ */
+void perfctr_start(void)
+{
+    int i;
+
+    for (i = 0; i < PERFCTR_NEVENTS; i++) {
+	if (fds[i] >= 0) {
+	    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+}
+
+/*
+ * perfctr_stop - disable the counters and add up what they counted
+ */
+void perfctr_stop(void)
+{
+    struct reading r;
+    double value;
+    int i;
+
+    for (i = 0; i < PERFCTR_NEVENTS; i++) {
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (i = 0; i < PERFCTR_NEVENTS; i++) {
+	if (fds[i] < 0 || read(fds[i], &r, sizeof(r)) != sizeof(r))
+	    continue;
+	value = r.value;
+	if (r.time_running > 0 && r.time_running < r.time_enabled)
+	    value *= (double)r.time_enabled / r.time_running;
+	totals[i] += value;
+    }
+    runs++;
+}
+
+#else
+
+int perfctr_init(void)
+{
+    return 0;
+}
+
+void perfctr_start(void)
+{
+}
+
+void perfctr_stop(void)
+{
+    runs++;
+}
+
+#endif
+
+/*
+ * perfctr_reset - start a new set of runs
+ */
+void perfctr_reset(void)
+{
+    memset(totals, 0, sizeof(totals));
+    runs = 0;
+}
+
+/*
+ * perfctr_read - mean count per run since the last reset
+ */
+void perfctr_read(double counts[PERFCTR_NEVENTS])
+{
+    int i;
+
+    for (i = 0; i < PERFCTR_NEVENTS; i++) {
+	if (fds[i] < 0)
+	    counts[i] = -1;
+	else
+	    counts[i] = (runs > 0) ? totals[i] / runs : 0;
+    }
+}
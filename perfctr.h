@@ -0,0 +1,26 @@
+/*
+ * perfctr.h - hardware event counters (Linux perf_event_open), read
+ *     around each timed run of a test function
+ */
+
+#define PERFCTR_NEVENTS 6
+
+/* Short names of the events, in the order perfctr_read reports them */
+extern const char *perfctr_names[PERFCTR_NEVENTS];
+
+/* Open a counter for each event in this process. Returns the number
+   of events that could be opened; 0 means there are no counters */
+int perfctr_init(void);
+
+/* Zero the totals kept by perfctr_stop */
+void perfctr_reset(void);
+
+/* Count events from now... */
+void perfctr_start(void);
+
+/* ...until now, and add the counts to the totals */
+void perfctr_stop(void);
+
+/* Mean count per run since the last reset, or -1 for events that
+   could not be opened */
+void perfctr_read(double counts[PERFCTR_NEVENTS]);
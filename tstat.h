@@ -0,0 +1,17 @@
+/*
+ * tstat.h - Student's t distribution, used to decide whether two
+ *     sets of timing samples really differ
+ */
+
+/* Probability that a t-distributed variable with df degrees of
+   freedom is at most t */
+double tstat_cdf(double t, double df);
+
+/* Value t such that tstat_cdf(t, df) == p, for 0 < p < 1 */
+double tstat_quantile(double p, double df);
+
+/* Welch's t statistic and its degrees of freedom for the difference
+   of two sample means (mean1 - mean0). Returns 0 and sets *df to 0 if
+   neither sample has any spread. */
+double tstat_welch(double mean1, double sd1, int n1,
+                   double mean0, double sd0, int n0, double *df);